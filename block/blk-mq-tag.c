@@ -0,0 +1,173 @@
+/*
+ * Tag allocation for the multi-queue block layer.
+ *
+ * Each hardware queue owns a tag space.  Tags are found with a lockless
+ * bitmap scan that starts at a per-cpu hint, so CPUs submitting to the
+ * same hardware queue mostly end up working on different cachelines.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/bitops.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+
+struct blk_mq_tags {
+	unsigned int		nr_tags;
+	unsigned int		nr_reserved_tags;
+
+	unsigned long		*tag_map;	/* set bit == busy tag */
+	unsigned long		*reserved_map;
+
+	unsigned int __percpu	*alloc_hint;
+
+	wait_queue_head_t	wait;
+};
+
+static int __bitmap_get_tag(unsigned long *map, unsigned int start,
+			    unsigned int end)
+{
+	unsigned int tag = start;
+
+	while ((tag = find_next_zero_bit(map, end, tag)) < end) {
+		if (!test_and_set_bit(tag, map))
+			return tag;
+		tag++;
+	}
+
+	return -1;
+}
+
+static unsigned int __blk_mq_get_tag(struct blk_mq_tags *tags, bool reserved)
+{
+	unsigned int depth, hint;
+	int tag;
+
+	if (unlikely(reserved)) {
+		tag = __bitmap_get_tag(tags->reserved_map, 0,
+				       tags->nr_reserved_tags);
+		return tag < 0 ? BLK_MQ_TAG_FAIL : tag;
+	}
+
+	depth = tags->nr_tags - tags->nr_reserved_tags;
+	hint = this_cpu_read(*tags->alloc_hint);
+	if (hint >= depth)
+		hint = 0;
+
+	tag = __bitmap_get_tag(tags->tag_map, hint, depth);
+	if (tag < 0 && hint)
+		tag = __bitmap_get_tag(tags->tag_map, 0, hint);
+	if (tag < 0)
+		return BLK_MQ_TAG_FAIL;
+
+	this_cpu_write(*tags->alloc_hint, tag + 1);
+	return tag + tags->nr_reserved_tags;
+}
+
+/**
+ * blk_mq_get_tag - allocate a tag
+ * @tags:	tag space of the hardware queue
+ * @gfp:	if it includes __GFP_WAIT, sleep until a tag becomes free
+ * @reserved:	allocate from the reserved pool
+ *
+ * Returns the tag, or %BLK_MQ_TAG_FAIL if none was available and we
+ * weren't allowed to wait for one.
+ */
+unsigned int blk_mq_get_tag(struct blk_mq_tags *tags, gfp_t gfp, bool reserved)
+{
+	DEFINE_WAIT(wait);
+	unsigned int tag;
+
+	tag = __blk_mq_get_tag(tags, reserved);
+	if (tag != BLK_MQ_TAG_FAIL || !(gfp & __GFP_WAIT))
+		return tag;
+
+	for (;;) {
+		prepare_to_wait(&tags->wait, &wait, TASK_UNINTERRUPTIBLE);
+
+		tag = __blk_mq_get_tag(tags, reserved);
+		if (tag != BLK_MQ_TAG_FAIL)
+			break;
+
+		io_schedule();
+	}
+	finish_wait(&tags->wait, &wait);
+
+	return tag;
+}
+
+void blk_mq_put_tag(struct blk_mq_tags *tags, unsigned int tag)
+{
+	if (tag >= tags->nr_reserved_tags) {
+		BUG_ON(tag >= tags->nr_tags);
+		clear_bit(tag - tags->nr_reserved_tags, tags->tag_map);
+	} else
+		clear_bit(tag, tags->reserved_map);
+
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(&tags->wait))
+		wake_up(&tags->wait);
+}
+
+unsigned int blk_mq_tags_busy(struct blk_mq_tags *tags)
+{
+	return bitmap_weight(tags->tag_map,
+			     tags->nr_tags - tags->nr_reserved_tags) +
+	       bitmap_weight(tags->reserved_map, tags->nr_reserved_tags);
+}
+
+struct blk_mq_tags *blk_mq_init_tags(unsigned int total_tags,
+				     unsigned int reserved_tags, int node)
+{
+	unsigned int nr_tags = total_tags - reserved_tags;
+	struct blk_mq_tags *tags;
+
+	if (total_tags > BLK_MQ_MAX_DEPTH || reserved_tags >= total_tags) {
+		pr_err("blk-mq: tag depth %u (%u reserved) out of range\n",
+		       total_tags, reserved_tags);
+		return NULL;
+	}
+
+	tags = kzalloc_node(sizeof(*tags), GFP_KERNEL, node);
+	if (!tags)
+		return NULL;
+
+	tags->nr_tags = total_tags;
+	tags->nr_reserved_tags = reserved_tags;
+	init_waitqueue_head(&tags->wait);
+
+	tags->tag_map = kzalloc_node(BITS_TO_LONGS(nr_tags) * sizeof(long),
+				     GFP_KERNEL, node);
+	if (!tags->tag_map)
+		goto err_free;
+
+	if (reserved_tags) {
+		tags->reserved_map = kzalloc_node(BITS_TO_LONGS(reserved_tags) *
+						  sizeof(long), GFP_KERNEL,
+						  node);
+		if (!tags->reserved_map)
+			goto err_free;
+	}
+
+	tags->alloc_hint = alloc_percpu(unsigned int);
+	if (!tags->alloc_hint)
+		goto err_free;
+
+	return tags;
+
+err_free:
+	blk_mq_free_tags(tags);
+	return NULL;
+}
+
+void blk_mq_free_tags(struct blk_mq_tags *tags)
+{
+	free_percpu(tags->alloc_hint);
+	kfree(tags->reserved_map);
+	kfree(tags->tag_map);
+	kfree(tags);
+}
@@ -0,0 +1,823 @@
+/*
+ * Multi-queue block IO queueing.
+ *
+ * Bios are turned into requests on per-cpu software queues, which are
+ * mapped onto one or more hardware dispatch queues provided by the driver.
+ * Neither submission nor completion takes q->queue_lock.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/backing-dev.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/mm.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/smp.h>
+#include <linux/cpumask.h>
+#include <linux/delay.h>
+#include <linux/blk-mq.h>
+
+#include <trace/events/block.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+
+/*
+ * How many requests back on the software queue we look for a merge
+ * candidate.  Keeps the ctx lock hold time bounded.
+ */
+#define BLK_MQ_MERGE_DEPTH	8
+
+static struct blk_mq_ctx *__blk_mq_get_ctx(struct request_queue *q,
+					   unsigned int cpu)
+{
+	return per_cpu_ptr(q->queue_ctx, cpu);
+}
+
+/*
+ * The ctx is only a locality hint: if we migrate after picking it, the
+ * ctx lock still keeps its list consistent and the owning hardware queue
+ * drains it regardless of which CPU we ended up on.
+ */
+static struct blk_mq_ctx *blk_mq_get_ctx(struct request_queue *q)
+{
+	return __blk_mq_get_ctx(q, raw_smp_processor_id());
+}
+
+/*
+ * Default CPU to hardware queue mapping, hands out contiguous ranges of
+ * CPUs to each hardware queue.
+ */
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+static void blk_mq_map_queues(unsigned int *map, unsigned int nr_queues)
+{
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu)
+		map[cpu] = (cpu * nr_queues) / nr_cpu_ids;
+}
+
+static void blk_mq_rq_ctx_init(struct request_queue *q, struct blk_mq_ctx *ctx,
+			       struct request *rq, unsigned int rw_flags)
+{
+	int tag = rq->tag;
+
+	blk_rq_init(q, rq);
+	rq->tag = tag;
+	rq->mq_ctx = ctx;
+	rq->cmd_flags = rw_flags;
+	if (blk_queue_io_stat(q))
+		rq->cmd_flags |= REQ_IO_STAT;
+}
+
+static struct request *__blk_mq_alloc_request(struct blk_mq_hw_ctx *hctx,
+					      gfp_t gfp, bool reserved)
+{
+	struct request *rq;
+	unsigned int tag;
+
+	tag = blk_mq_get_tag(hctx->tags, gfp, reserved);
+	if (tag == BLK_MQ_TAG_FAIL)
+		return NULL;
+
+	rq = hctx->rqs[tag];
+	rq->tag = tag;
+	return rq;
+}
+
+static struct request *blk_mq_alloc_request_pinned(struct request_queue *q,
+						   int rw, gfp_t gfp,
+						   bool reserved)
+{
+	struct blk_mq_ctx *ctx = blk_mq_get_ctx(q);
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	struct request *rq;
+
+	rq = __blk_mq_alloc_request(hctx, gfp, reserved);
+	if (rq)
+		blk_mq_rq_ctx_init(q, ctx, rq, rw);
+
+	return rq;
+}
+
+struct request *blk_mq_alloc_request(struct request_queue *q, int rw,
+				     gfp_t gfp)
+{
+	return blk_mq_alloc_request_pinned(q, rw, gfp, false);
+}
+EXPORT_SYMBOL(blk_mq_alloc_request);
+
+struct request *blk_mq_alloc_reserved_request(struct request_queue *q, int rw,
+					      gfp_t gfp)
+{
+	return blk_mq_alloc_request_pinned(q, rw, gfp, true);
+}
+EXPORT_SYMBOL(blk_mq_alloc_reserved_request);
+
+void blk_mq_free_request(struct request *rq)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, ctx->cpu);
+	unsigned int tag = rq->tag;
+
+	/* this is a bio leak */
+	WARN_ON(rq->bio != NULL);
+
+	rq->cmd_flags = 0;
+	blk_mq_put_tag(hctx->tags, tag);
+}
+EXPORT_SYMBOL(blk_mq_free_request);
+
+/**
+ * blk_mq_end_io - complete a request
+ * @rq:		the request being completed
+ * @error:	%0 for success, < %0 for error
+ *
+ * Description:
+ *     Ends all I/O on @rq and releases its tag.  May be called from
+ *     hard or soft irq context, no queue lock is taken.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+		BUG();
+
+	blk_account_io_done(rq);
+
+	if (rq->end_io)
+		rq->end_io(rq, error);
+	else
+		blk_mq_free_request(rq);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+static void blk_mq_start_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	trace_block_rq_issue(q, rq);
+
+	/*
+	 * We are now handing the request to the hardware, initialize
+	 * resid_len to full count.
+	 */
+	rq->resid_len = blk_rq_bytes(rq);
+	set_io_start_time_ns(rq);
+}
+
+static void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx,
+				    struct request *rq, bool at_head)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+
+	trace_block_rq_insert(hctx->queue, rq);
+
+	if (at_head)
+		list_add(&rq->queuelist, &ctx->rq_list);
+	else
+		list_add_tail(&rq->queuelist, &ctx->rq_list);
+	set_bit(ctx->index_hw, hctx->ctx_map);
+}
+
+/*
+ * Run this hardware queue, pulling any software queues mapped to it in.
+ * Note that this function currently has various problems around ordering
+ * of IO. In particular, we'd like FIFO behaviour on handling existing
+ * items on the hctx->dispatch list. Ignore that for now.
+ */
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	LIST_HEAD(rq_list);
+	int bit;
+
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	hctx->run++;
+
+	/*
+	 * Touch any software queue that has pending entries.  The bit is
+	 * cleared before the list is spliced, so a concurrent insert either
+	 * lands on the list we take or sets the bit again.
+	 */
+	for_each_set_bit(bit, hctx->ctx_map, hctx->nr_ctx) {
+		clear_bit(bit, hctx->ctx_map);
+		ctx = hctx->ctxs[bit];
+
+		spin_lock(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock(&ctx->lock);
+	}
+
+	/*
+	 * If we have previous entries on our dispatch list, grab them
+	 * and stuff them at the front for more fair dispatch.
+	 */
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock(&hctx->lock);
+		if (!list_empty(&hctx->dispatch))
+			list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock(&hctx->lock);
+	}
+
+	/*
+	 * Now process all the entries, sending them to the driver.
+	 */
+	while (!list_empty(&rq_list)) {
+		int ret;
+
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+
+		blk_mq_start_request(rq);
+
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		if (ret == BLK_MQ_RQ_QUEUE_OK) {
+			rq->mq_ctx->rq_dispatched[rq_is_sync(rq)]++;
+			continue;
+		}
+
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY) {
+			/*
+			 * The driver is out of resources and is expected to
+			 * have stopped the queue, restarting it once
+			 * something completes.
+			 */
+			list_add(&rq->queuelist, &rq_list);
+			break;
+		}
+
+		pr_err("blk-mq: bad return on queue: %d\n", ret);
+		rq->errors = -EIO;
+		blk_mq_end_io(rq, rq->errors);
+	}
+
+	/*
+	 * Any items that need requeuing? Stuff them into hctx->dispatch,
+	 * that is where we will continue on next queue run.
+	 */
+	if (!list_empty(&rq_list)) {
+		spin_lock(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock(&hctx->lock);
+
+		/*
+		 * The driver stopped the queue before returning BUSY, and a
+		 * completion may have restarted and run it before the splice
+		 * above, finding nothing on hctx->dispatch.  Pairs with the
+		 * test_and_clear_bit() in blk_mq_start_stopped_hw_queues():
+		 * either that run sees the requests, or we see the queue
+		 * running again and kick it ourselves.
+		 */
+		smp_mb();
+		if (!test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			blk_mq_run_hw_queue(hctx, true);
+	}
+}
+
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (!async)
+		__blk_mq_run_hw_queue(hctx);
+	else
+		kblockd_schedule_delayed_work(hctx->queue,
+					      &hctx->delayed_work, 0);
+}
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_run_hw_queue(hctx, async);
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	cancel_delayed_work(&hctx->delayed_work);
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+void blk_mq_stop_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_stop_hw_queue(hctx);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queues);
+
+/*
+ * Safe to call from any context, the restarted queues are run from
+ * kblockd.
+ */
+void blk_mq_start_stopped_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_and_clear_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+
+		blk_mq_run_hw_queue(hctx, true);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+static void blk_mq_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, delayed_work.work);
+	__blk_mq_run_hw_queue(hctx);
+}
+
+/**
+ * blk_mq_insert_request - queue a prepared request for dispatch
+ * @q:		the multi-queue request_queue
+ * @rq:		request allocated through blk_mq_alloc_request()
+ * @at_head:	insert at the head of the software queue
+ * @run_queue:	kick the hardware queue right away
+ *
+ * Must be called from process context.
+ */
+void blk_mq_insert_request(struct request_queue *q, struct request *rq,
+			   bool at_head, bool run_queue)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	spin_lock(&ctx->lock);
+	__blk_mq_insert_request(hctx, rq, at_head);
+	spin_unlock(&ctx->lock);
+
+	if (run_queue)
+		blk_mq_run_hw_queue(hctx, false);
+}
+EXPORT_SYMBOL(blk_mq_insert_request);
+
+/*
+ * Look for a request on the software queue that @bio can be merged into.
+ * Only the most recently queued requests are considered.
+ */
+static bool blk_mq_attempt_merge(struct request_queue *q,
+				 struct blk_mq_ctx *ctx, struct bio *bio)
+{
+	struct request *rq;
+	int checked = BLK_MQ_MERGE_DEPTH;
+
+	list_for_each_entry_reverse(rq, &ctx->rq_list, queuelist) {
+		int el_ret;
+
+		if (!checked--)
+			break;
+
+		if (!blk_rq_merge_ok(rq, bio))
+			continue;
+
+		el_ret = blk_try_merge(rq, bio);
+		if (el_ret == ELEVATOR_BACK_MERGE) {
+			if (bio_attempt_back_merge(q, rq, bio)) {
+				ctx->rq_merged++;
+				return true;
+			}
+			break;
+		} else if (el_ret == ELEVATOR_FRONT_MERGE) {
+			if (bio_attempt_front_merge(q, rq, bio)) {
+				ctx->rq_merged++;
+				return true;
+			}
+			break;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Flush sequencing.  Drivers only ever see empty REQ_FLUSH requests and,
+ * if they advertised it, REQ_FUA writes.  A data bio that needs a flush
+ * before or after it is split into up to three steps which are issued
+ * one after the other from kblockd.
+ */
+#define BLK_MQ_FSEQ_PREFLUSH	(1 << 0)
+#define BLK_MQ_FSEQ_DATA	(1 << 1)
+#define BLK_MQ_FSEQ_POSTFLUSH	(1 << 2)
+
+struct blk_mq_flush_seq {
+	struct work_struct	work;
+	struct request_queue	*q;
+	struct bio		*bio;		/* the original bio */
+	unsigned int		policy;		/* steps left to issue */
+	int			error;
+};
+
+static void blk_mq_make_request(struct request_queue *q, struct bio *bio);
+
+static unsigned int blk_mq_flush_policy(struct request_queue *q,
+					struct bio *bio)
+{
+	unsigned int fflags = q->flush_flags;
+	unsigned int policy = 0;
+
+	if (bio->bi_size)
+		policy |= BLK_MQ_FSEQ_DATA;
+
+	if (fflags & REQ_FLUSH) {
+		if (bio->bi_rw & REQ_FLUSH)
+			policy |= BLK_MQ_FSEQ_PREFLUSH;
+		if (!(fflags & REQ_FUA) && (bio->bi_rw & REQ_FUA) &&
+		    bio->bi_size)
+			policy |= BLK_MQ_FSEQ_POSTFLUSH;
+	}
+	return policy;
+}
+
+static void blk_mq_flush_seq_end_io(struct bio *bio, int error)
+{
+	struct blk_mq_flush_seq *fseq = bio->bi_private;
+
+	if (error)
+		fseq->error = error;
+	bio_put(bio);
+
+	kblockd_schedule_work(fseq->q, &fseq->work);
+}
+
+static void blk_mq_flush_seq_work(struct work_struct *work)
+{
+	struct blk_mq_flush_seq *fseq =
+		container_of(work, struct blk_mq_flush_seq, work);
+	struct bio *orig = fseq->bio;
+	struct bio *bio;
+
+	if (fseq->error || !fseq->policy) {
+		bio_endio(orig, fseq->error);
+		kfree(fseq);
+		return;
+	}
+
+	if (fseq->policy & BLK_MQ_FSEQ_DATA) {
+		unsigned long clear = REQ_FLUSH;
+
+		if (!(fseq->q->flush_flags & REQ_FUA))
+			clear |= REQ_FUA;
+
+		if (fseq->policy & BLK_MQ_FSEQ_PREFLUSH) {
+			fseq->policy &= ~BLK_MQ_FSEQ_PREFLUSH;
+			bio = bio_alloc(GFP_NOIO, 0);
+			bio->bi_bdev = orig->bi_bdev;
+			bio->bi_rw = WRITE_FLUSH;
+		} else {
+			fseq->policy &= ~BLK_MQ_FSEQ_DATA;
+			bio = bio_clone(orig, GFP_NOIO);
+			bio->bi_rw &= ~clear;
+		}
+	} else {
+		fseq->policy &= ~BLK_MQ_FSEQ_POSTFLUSH;
+		bio = bio_alloc(GFP_NOIO, 0);
+		bio->bi_bdev = orig->bi_bdev;
+		bio->bi_rw = WRITE_FLUSH;
+	}
+
+	bio->bi_end_io = blk_mq_flush_seq_end_io;
+	bio->bi_private = fseq;
+	blk_mq_make_request(fseq->q, bio);
+}
+
+/*
+ * Returns %true if @bio was taken over by the flush machinery, otherwise
+ * the flags the driver can't handle have been stripped and @bio can be
+ * queued like any other.
+ */
+static bool blk_mq_handle_flush(struct request_queue *q, struct bio *bio)
+{
+	unsigned int policy = blk_mq_flush_policy(q, bio);
+	struct blk_mq_flush_seq *fseq;
+
+	if (!(policy & BLK_MQ_FSEQ_DATA)) {
+		/* empty flush, either the driver handles it or it's a nop */
+		if (!policy) {
+			bio_endio(bio, 0);
+			return true;
+		}
+		return false;
+	}
+
+	if (policy == BLK_MQ_FSEQ_DATA) {
+		if (!(q->flush_flags & REQ_FUA))
+			bio->bi_rw &= ~REQ_FUA;
+		bio->bi_rw &= ~REQ_FLUSH;
+		return false;
+	}
+
+	fseq = kmalloc(sizeof(*fseq), GFP_NOIO);
+	if (!fseq) {
+		bio_endio(bio, -ENOMEM);
+		return true;
+	}
+
+	INIT_WORK(&fseq->work, blk_mq_flush_seq_work);
+	fseq->q = q;
+	fseq->bio = bio;
+	fseq->policy = policy;
+	fseq->error = 0;
+
+	/* issue the first step right away, we're in process context */
+	blk_mq_flush_seq_work(&fseq->work);
+	return true;
+}
+
+static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	const bool is_sync = rw_is_sync(bio->bi_rw);
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_mq_ctx *ctx;
+	struct request *rq;
+	unsigned int rw_flags;
+
+	if (unlikely(blk_queue_dead(q))) {
+		bio_endio(bio, -ENODEV);
+		return;
+	}
+
+	/*
+	 * low level driver can indicate that it wants pages above a
+	 * certain limit bounced to low memory (ie for highmem, or even
+	 * ISA dma in theory)
+	 */
+	blk_queue_bounce(q, &bio);
+
+	if (unlikely(bio->bi_rw & (REQ_FLUSH | REQ_FUA)) &&
+	    blk_mq_handle_flush(q, bio))
+		return;
+
+	ctx = blk_mq_get_ctx(q);
+	hctx = q->mq_ops->map_queue(q, ctx->cpu);
+
+	if ((hctx->flags & BLK_MQ_F_SHOULD_MERGE) && !blk_queue_nomerges(q) &&
+	    !(bio->bi_rw & (REQ_FLUSH | REQ_FUA))) {
+		bool merged;
+
+		spin_lock(&ctx->lock);
+		merged = blk_mq_attempt_merge(q, ctx, bio);
+		spin_unlock(&ctx->lock);
+
+		if (merged)
+			return;
+	}
+
+	rw_flags = bio_data_dir(bio);
+	if (is_sync)
+		rw_flags |= REQ_SYNC;
+
+	trace_block_getrq(q, bio, rw_flags);
+
+	/*
+	 * Grab a free request. This might sleep but can not fail.
+	 */
+	rq = __blk_mq_alloc_request(hctx, GFP_NOIO, false);
+	blk_mq_rq_ctx_init(q, ctx, rq, rw_flags);
+
+	init_request_from_bio(rq, bio);
+	drive_stat_acct(rq, 1);
+
+	spin_lock(&ctx->lock);
+	__blk_mq_insert_request(hctx, rq, false);
+	spin_unlock(&ctx->lock);
+	hctx->queued++;
+
+	/*
+	 * Sync IO is dispatched from the submitting context, async IO is
+	 * left for kblockd so that it can be batched up.
+	 */
+	blk_mq_run_hw_queue(hctx, !is_sync);
+}
+
+/**
+ * blk_mq_drain_queue - wait for all requests on @q to complete
+ * @q: the multi-queue request_queue, already marked DEAD
+ */
+void blk_mq_drain_queue(struct request_queue *q)
+{
+	while (true) {
+		struct blk_mq_hw_ctx *hctx;
+		unsigned int busy = 0;
+		int i;
+
+		blk_mq_run_queues(q, false);
+
+		queue_for_each_hw_ctx(q, hctx, i)
+			busy += blk_mq_tags_busy(hctx->tags);
+
+		if (!busy)
+			break;
+		msleep(10);
+	}
+}
+
+static void blk_mq_free_hw_queue(struct blk_mq_hw_ctx *hctx, unsigned int i)
+{
+	struct request_queue *q = hctx->queue;
+	unsigned int j;
+
+	cancel_delayed_work_sync(&hctx->delayed_work);
+
+	if (q->mq_ops->exit_hctx)
+		q->mq_ops->exit_hctx(hctx, i);
+
+	if (hctx->rqs) {
+		for (j = 0; j < hctx->queue_depth; j++)
+			kfree(hctx->rqs[j]);
+		kfree(hctx->rqs);
+	}
+	if (hctx->tags)
+		blk_mq_free_tags(hctx->tags);
+	kfree(hctx->ctxs);
+	kfree(hctx->ctx_map);
+	free_cpumask_var(hctx->cpumask);
+	kfree(hctx);
+}
+
+/*
+ * Called on the final put of the queue, tolerates a partially set up
+ * queue from a failed blk_mq_init_queue().
+ */
+void blk_mq_free_queue(struct request_queue *q)
+{
+	unsigned int i;
+
+	if (q->queue_hw_ctx) {
+		for (i = 0; i < q->nr_hw_queues; i++)
+			if (q->queue_hw_ctx[i])
+				blk_mq_free_hw_queue(q->queue_hw_ctx[i], i);
+		kfree(q->queue_hw_ctx);
+	}
+
+	free_percpu(q->queue_ctx);
+	kfree(q->mq_map);
+
+	q->queue_hw_ctx = NULL;
+	q->queue_ctx = NULL;
+	q->mq_map = NULL;
+}
+
+static int blk_mq_init_hw_queue(struct request_queue *q,
+				struct blk_mq_hw_ctx *hctx,
+				struct blk_mq_reg *reg, void *driver_data,
+				unsigned int i)
+{
+	size_t rq_size = sizeof(struct request) + reg->cmd_size;
+	int node = reg->numa_node;
+	unsigned int j;
+
+	spin_lock_init(&hctx->lock);
+	INIT_LIST_HEAD(&hctx->dispatch);
+	INIT_DELAYED_WORK(&hctx->delayed_work, blk_mq_work_fn);
+	hctx->queue = q;
+	hctx->driver_data = driver_data;
+	hctx->flags = reg->flags;
+	hctx->queue_num = i;
+	hctx->queue_depth = reg->queue_depth;
+	hctx->numa_node = node;
+
+	if (!zalloc_cpumask_var(&hctx->cpumask, GFP_KERNEL))
+		return -ENOMEM;
+
+	hctx->ctxs = kmalloc_node(nr_cpu_ids * sizeof(void *), GFP_KERNEL,
+				  node);
+	hctx->ctx_map = kzalloc_node(BITS_TO_LONGS(nr_cpu_ids) * sizeof(long),
+				     GFP_KERNEL, node);
+	if (!hctx->ctxs || !hctx->ctx_map)
+		return -ENOMEM;
+
+	hctx->tags = blk_mq_init_tags(reg->queue_depth, reg->reserved_tags,
+				      node);
+	if (!hctx->tags)
+		return -ENOMEM;
+
+	hctx->rqs = kzalloc_node(reg->queue_depth * sizeof(struct request *),
+				 GFP_KERNEL, node);
+	if (!hctx->rqs)
+		return -ENOMEM;
+
+	for (j = 0; j < reg->queue_depth; j++) {
+		hctx->rqs[j] = kzalloc_node(rq_size, GFP_KERNEL, node);
+		if (!hctx->rqs[j])
+			return -ENOMEM;
+		hctx->rqs[j]->tag = j;
+	}
+
+	if (reg->ops->init_hctx)
+		return reg->ops->init_hctx(hctx, driver_data, i);
+
+	return 0;
+}
+
+static void blk_mq_map_swqueue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct blk_mq_ctx *ctx = __blk_mq_get_ctx(q, cpu);
+
+		memset(ctx, 0, sizeof(*ctx));
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->rq_list);
+		ctx->cpu = cpu;
+		ctx->queue = q;
+
+		hctx = q->mq_ops->map_queue(q, cpu);
+		cpumask_set_cpu(cpu, hctx->cpumask);
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+	}
+}
+
+/**
+ * blk_mq_init_queue - set up a multi-queue request_queue
+ * @reg:	hardware queue description
+ * @driver_data: stored in each &struct blk_mq_hw_ctx
+ *
+ * Description:
+ *    Returns a request_queue whose bios are queued on per-cpu software
+ *    queues and dispatched through @reg->ops->queue_rq, or an ERR_PTR().
+ *    The queue is torn down with blk_cleanup_queue() as usual.
+ */
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct request_queue *q;
+	unsigned int i;
+
+	if (!reg->nr_hw_queues || !reg->ops->queue_rq ||
+	    !reg->ops->map_queue || !reg->queue_depth ||
+	    reg->queue_depth > BLK_MQ_MAX_DEPTH ||
+	    reg->reserved_tags >= reg->queue_depth)
+		return ERR_PTR(-EINVAL);
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		return ERR_PTR(-ENOMEM);
+
+	q->mq_ops = reg->ops;
+	q->nr_queues = nr_cpu_ids;
+	q->nr_hw_queues = reg->nr_hw_queues;
+
+	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
+	q->mq_map = kzalloc_node(nr_cpu_ids * sizeof(unsigned int),
+				 GFP_KERNEL, reg->numa_node);
+	q->queue_hw_ctx = kzalloc_node(reg->nr_hw_queues * sizeof(void *),
+				       GFP_KERNEL, reg->numa_node);
+	if (!q->queue_ctx || !q->mq_map || !q->queue_hw_ctx)
+		goto err;
+
+	blk_mq_map_queues(q->mq_map, reg->nr_hw_queues);
+
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		struct blk_mq_hw_ctx *hctx;
+
+		hctx = kzalloc_node(sizeof(*hctx), GFP_KERNEL, reg->numa_node);
+		if (!hctx)
+			goto err;
+		q->queue_hw_ctx[i] = hctx;
+
+		if (blk_mq_init_hw_queue(q, hctx, reg, driver_data, i))
+			goto err;
+	}
+
+	blk_mq_map_swqueue(q);
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	q->nr_requests = reg->queue_depth * reg->nr_hw_queues;
+
+	return q;
+
+err:
+	blk_mq_free_queue(q);
+	q->mq_ops = NULL;
+	blk_cleanup_queue(q);
+	return ERR_PTR(-ENOMEM);
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
@@ -2,6 +2,7 @@
 #include <linux/spinlock.h>
 #include <linux/slab.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/hdreg.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
@@ -17,6 +18,10 @@
 static int major;
 static DEFINE_IDA(vd_index_ida);
 
+static bool use_mq = true;
+module_param(use_mq, bool, S_IRUGO);
+MODULE_PARM_DESC(use_mq, "Queue requests through the multi-queue block layer");
+
 struct workqueue_struct *virtblk_wq;
 
 struct virtio_blk
@@ -65,6 +70,7 @@ struct virtblk_req
 static void blk_done(struct virtqueue *vq)
 {
 	struct virtio_blk *vblk = vq->vdev->priv;
+	struct request_queue *q = vblk->disk->queue;
 	struct virtblk_req *vbr;
 	unsigned int len;
 	unsigned long flags;
@@ -98,27 +104,32 @@ static void blk_done(struct virtqueue *vq)
 			break;
 		}
 
-		__blk_end_request_all(vbr->req, error);
+		/* with blk-mq, vbr lives in the request and goes away with it */
 		list_del(&vbr->list);
-		mempool_free(vbr, vblk->pool);
+		if (q->mq_ops)
+			blk_mq_end_io(vbr->req, error);
+		else {
+			__blk_end_request_all(vbr->req, error);
+			mempool_free(vbr, vblk->pool);
+		}
 	}
 	/* In case queue is stopped waiting for more buffers. */
-	blk_start_queue(vblk->disk->queue);
+	if (q->mq_ops)
+		blk_mq_start_stopped_hw_queues(q);
+	else
+		blk_start_queue(q);
 	spin_unlock_irqrestore(&vblk->lock, flags);
 }
 
-static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
-		   struct request *req)
+/*
+ * Must be called with vblk->lock held.  Returns false if the virtqueue
+ * is full.
+ */
+static bool __virtblk_add_req(struct request_queue *q, struct virtio_blk *vblk,
+			      struct virtblk_req *vbr)
 {
 	unsigned long num, out = 0, in = 0;
-	struct virtblk_req *vbr;
-
-	vbr = mempool_alloc(vblk->pool, GFP_ATOMIC);
-	if (!vbr)
-		/* When another request finishes we'll try again. */
-		return false;
-
-	vbr->req = req;
+	struct request *req = vbr->req;
 
 	if (req->cmd_flags & REQ_FLUSH) {
 		vbr->out_hdr.type = VIRTIO_BLK_T_FLUSH;
@@ -179,12 +190,30 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 		}
 	}
 
-	if (virtqueue_add_buf(vblk->vq, vblk->sg, out, in, vbr, GFP_ATOMIC)<0) {
+	if (virtqueue_add_buf(vblk->vq, vblk->sg, out, in, vbr, GFP_ATOMIC)<0)
+		return false;
+
+	list_add_tail(&vbr->list, &vblk->reqs);
+	return true;
+}
+
+static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
+		   struct request *req)
+{
+	struct virtblk_req *vbr;
+
+	vbr = mempool_alloc(vblk->pool, GFP_ATOMIC);
+	if (!vbr)
+		/* When another request finishes we'll try again. */
+		return false;
+
+	vbr->req = req;
+
+	if (!__virtblk_add_req(q, vblk, vbr)) {
 		mempool_free(vbr, vblk->pool);
 		return false;
 	}
 
-	list_add_tail(&vbr->list, &vblk->reqs);
 	return true;
 }
 
@@ -211,6 +240,50 @@ static void do_virtblk_request(struct request_queue *q)
 		virtqueue_kick(vblk->vq);
 }
 
+static int virtio_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *req)
+{
+	struct virtio_blk *vblk = hctx->queue->queuedata;
+	struct virtblk_req *vbr = blk_mq_rq_to_pdu(req);
+	unsigned long flags;
+	bool notify;
+
+	BUG_ON(req->nr_phys_segments + 2 > vblk->sg_elems);
+
+	vbr->req = req;
+
+	spin_lock_irqsave(&vblk->lock, flags);
+	if (!__virtblk_add_req(hctx->queue, vblk, vbr)) {
+		/*
+		 * Stopping under vblk->lock serializes against blk_done(),
+		 * which restarts us once buffers have been returned.
+		 */
+		blk_mq_stop_hw_queue(hctx);
+		spin_unlock_irqrestore(&vblk->lock, flags);
+		return BLK_MQ_RQ_QUEUE_BUSY;
+	}
+	notify = virtqueue_kick_prepare(vblk->vq);
+	spin_unlock_irqrestore(&vblk->lock, flags);
+
+	if (notify)
+		virtqueue_notify(vblk->vq);
+
+	return BLK_MQ_RQ_QUEUE_OK;
+}
+
+static struct blk_mq_ops virtio_mq_ops = {
+	.queue_rq	= virtio_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+};
+
+static struct blk_mq_reg virtio_mq_reg = {
+	.ops		= &virtio_mq_ops,
+	.nr_hw_queues	= 1,
+	.queue_depth	= 64,
+	.cmd_size	= sizeof(struct virtblk_req),
+	.numa_node	= NUMA_NO_NODE,
+	.flags		= BLK_MQ_F_SHOULD_MERGE,
+};
+
 /* return id (s/n) string for *disk to *id_str
  */
 static int virtblk_get_id(struct gendisk *disk, char *id_str)
@@ -463,11 +536,15 @@ static int __devinit virtblk_probe(struct virtio_device *vdev)
 		goto out_mempool;
 	}
 
-	q = vblk->disk->queue = blk_init_queue(do_virtblk_request, &vblk->lock);
-	if (!q) {
-		err = -ENOMEM;
+	if (use_mq)
+		q = blk_mq_init_queue(&virtio_mq_reg, vblk);
+	else
+		q = blk_init_queue(do_virtblk_request, &vblk->lock);
+	if (IS_ERR_OR_NULL(q)) {
+		err = q ? PTR_ERR(q) : -ENOMEM;
 		goto out_put_disk;
 	}
+	vblk->disk->queue = q;
 
 	q->queuedata = vblk;
 
@@ -621,9 +698,13 @@ static int virtblk_freeze(struct virtio_device *vdev)
 
 	flush_work(&vblk->config_work);
 
-	spin_lock_irq(vblk->disk->queue->queue_lock);
-	blk_stop_queue(vblk->disk->queue);
-	spin_unlock_irq(vblk->disk->queue->queue_lock);
+	if (vblk->disk->queue->mq_ops)
+		blk_mq_stop_hw_queues(vblk->disk->queue);
+	else {
+		spin_lock_irq(vblk->disk->queue->queue_lock);
+		blk_stop_queue(vblk->disk->queue);
+		spin_unlock_irq(vblk->disk->queue->queue_lock);
+	}
 	blk_sync_queue(vblk->disk->queue);
 
 	vdev->config->del_vqs(vdev);
@@ -637,7 +718,12 @@ static int virtblk_restore(struct virtio_device *vdev)
 
 	vblk->config_enable = true;
 	ret = init_vq(vdev->priv);
-	if (!ret) {
+	if (ret)
+		return ret;
+
+	if (vblk->disk->queue->mq_ops)
+		blk_mq_start_stopped_hw_queues(vblk->disk->queue);
+	else {
 		spin_lock_irq(vblk->disk->queue->queue_lock);
 		blk_start_queue(vblk->disk->queue);
 		spin_unlock_irq(vblk->disk->queue->queue_lock);
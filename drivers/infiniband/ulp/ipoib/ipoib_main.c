@@ -710,12 +710,22 @@ static int ipoib_start_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct ipoib_dev_priv *priv = netdev_priv(dev);
 	struct ipoib_neigh *neigh;
-	struct neighbour *n = NULL;
+	struct neighbour *n = NULL, *held = NULL;
 	unsigned long flags;
 
 	rcu_read_lock();
 	if (likely(skb_dst(skb))) {
 		n = dst_get_neighbour_noref(skb_dst(skb));
+		/* IPv4 routes to a directly connected subnet carry no
+		 * neighbour, look up the one for this destination.
+		 */
+		if (!n && skb->protocol == htons(ETH_P_IP)) {
+			held = dst_neigh_lookup(skb_dst(skb),
+						&ip_hdr(skb)->daddr);
+			if (IS_ERR(held))
+				held = NULL;
+			n = held;
+		}
 		if (!n) {
 			++dev->stats.tx_dropped;
 			dev_kfree_skb_any(skb);
@@ -798,6 +808,8 @@ static int ipoib_start_xmit(struct sk_buff *skb, struct net_device *dev)
 	}
 unlock:
 	rcu_read_unlock();
+	if (held)
+		neigh_release(held);
 	return NETDEV_TX_OK;
 }
 
@@ -2120,6 +2120,8 @@ static int ixgbe_get_coalesce(struct net_device *netdev,
 	else
 		ec->rx_coalesce_usecs = adapter->rx_itr_setting >> 2;
 
+	ec->use_adaptive_rx_coalesce = !!(netdev->priv_flags & IFF_NAPI_DIM);
+
 	/* if in mixed tx/rx queues per vector mode, report only rx settings */
 	if (adapter->q_vector[0]->tx.count && adapter->q_vector[0]->rx.count)
 		return 0;
@@ -2183,6 +2185,15 @@ static int ixgbe_set_coalesce(struct net_device *netdev,
 	    (ec->tx_coalesce_usecs > (IXGBE_MAX_EITR >> 2)))
 		return -EINVAL;
 
+	/* adaptive-rx lets the core tune the dynamic ITR (IFF_NAPI_DIM) */
+	if (ec->use_adaptive_rx_coalesce && ec->rx_coalesce_usecs != 1)
+		return -EINVAL;
+
+	if (ec->use_adaptive_rx_coalesce)
+		netdev->priv_flags |= IFF_NAPI_DIM;
+	else
+		netdev->priv_flags &= ~IFF_NAPI_DIM;
+
 	if (ec->rx_coalesce_usecs > 1)
 		adapter->rx_itr_setting = ec->rx_coalesce_usecs << 2;
 	else
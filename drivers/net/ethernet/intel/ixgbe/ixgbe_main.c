@@ -41,6 +41,7 @@
 #include <linux/slab.h>
 #include <net/checksum.h>
 #include <net/ip6_checksum.h>
+#include <net/busy_poll.h>
 #include <linux/ethtool.h>
 #include <linux/if.h>
 #include <linux/if_vlan.h>
@@ -1389,6 +1390,8 @@ static void ixgbe_rx_skb(struct ixgbe_q_vector *q_vector,
 {
 	struct ixgbe_adapter *adapter = q_vector->adapter;
 
+	skb_mark_napi_id(skb, &q_vector->napi);
+
 	if (!(adapter->flags & IXGBE_FLAG_IN_NETPOLL))
 		napi_gro_receive(&q_vector->napi, skb);
 	else
@@ -1616,11 +1619,11 @@ static void ixgbe_add_rx_frag(struct ixgbe_ring *rx_ring,
  * expensive overhead for IOMMU access this provides a means of avoiding
  * it by maintaining the mapping of the page to the syste.
  *
- * Returns true if all work is completed without reaching budget
+ * Returns amount of work completed
  **/
-static bool ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
-			       struct ixgbe_ring *rx_ring,
-			       int budget)
+static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
+			      struct ixgbe_ring *rx_ring,
+			      int budget)
 {
 	unsigned int total_rx_bytes = 0, total_rx_packets = 0;
 #ifdef IXGBE_FCOE
@@ -1738,7 +1741,6 @@ static bool ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 
 		/* probably a little skewed due to removing CRC */
 		total_rx_bytes += skb->len;
-		total_rx_packets++;
 
 		/* populate checksum, timestamp, VLAN, and protocol */
 		ixgbe_process_skb_fields(rx_ring, rx_desc, skb);
@@ -1757,8 +1759,8 @@ static bool ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 		ixgbe_rx_skb(q_vector, skb);
 
 		/* update budget accounting */
-		budget--;
-	} while (likely(budget));
+		total_rx_packets++;
+	} while (likely(total_rx_packets < budget));
 
 #ifdef IXGBE_FCOE
 	/* include DDPed FCoE data */
@@ -1785,7 +1787,7 @@ static bool ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 	if (cleaned_count)
 		ixgbe_alloc_rx_buffers(rx_ring, cleaned_count);
 
-	return !!budget;
+	return total_rx_packets;
 }
 
 /**
@@ -2328,14 +2330,18 @@ int ixgbe_poll(struct napi_struct *napi, int budget)
 				container_of(napi, struct ixgbe_q_vector, napi);
 	struct ixgbe_adapter *adapter = q_vector->adapter;
 	struct ixgbe_ring *ring;
-	int per_ring_budget;
+	int per_ring_budget, work_done = 0;
 	bool clean_complete = true;
+	unsigned int tx_packets, bytes;
 
 #ifdef CONFIG_IXGBE_DCA
 	if (adapter->flags & IXGBE_FLAG_DCA_ENABLED)
 		ixgbe_update_dca(q_vector);
 #endif
 
+	tx_packets = q_vector->tx.total_packets;
+	bytes = q_vector->tx.total_bytes + q_vector->rx.total_bytes;
+
 	ixgbe_for_each_ring(ring, q_vector->tx)
 		clean_complete &= !!ixgbe_clean_tx_irq(q_vector, ring);
 
@@ -2346,17 +2352,32 @@ int ixgbe_poll(struct napi_struct *napi, int budget)
 	else
 		per_ring_budget = budget;
 
-	ixgbe_for_each_ring(ring, q_vector->rx)
-		clean_complete &= ixgbe_clean_rx_irq(q_vector, ring,
-						     per_ring_budget);
+	ixgbe_for_each_ring(ring, q_vector->rx) {
+		int cleaned = ixgbe_clean_rx_irq(q_vector, ring,
+						 per_ring_budget);
+
+		work_done += cleaned;
+		clean_complete &= (cleaned < per_ring_budget);
+	}
+
+	/* rx packets are reported as work done, tx completions and the
+	 * byte counts are fed to the core adaptive moderation here so
+	 * that tx only and mixed vectors are sampled too
+	 */
+	if (adapter->netdev->priv_flags & IFF_NAPI_DIM)
+		napi_dim_account(napi, q_vector->tx.total_packets - tx_packets,
+				 q_vector->tx.total_bytes +
+				 q_vector->rx.total_bytes - bytes);
 
 	/* If all work not completed, return budget and keep polling */
 	if (!clean_complete)
 		return budget;
 
 	/* all work done, exit the polling mode */
-	napi_complete(napi);
-	if (adapter->rx_itr_setting & 1)
+	napi_complete_done(napi, work_done);
+	/* the core adapts the ITR itself when adaptive-rx is on */
+	if ((adapter->rx_itr_setting & 1) &&
+	    !(adapter->netdev->priv_flags & IFF_NAPI_DIM))
 		ixgbe_set_itr(q_vector);
 	if (!test_bit(__IXGBE_DOWN, &adapter->state))
 		ixgbe_irq_enable_queues(adapter, ((u64)1 << q_vector->v_idx));
@@ -2364,6 +2385,93 @@ int ixgbe_poll(struct napi_struct *napi, int budget)
 	return 0;
 }
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+static bool ixgbe_rx_pending(struct ixgbe_q_vector *q_vector)
+{
+	struct ixgbe_ring *ring;
+
+	ixgbe_for_each_ring(ring, q_vector->rx)
+		if (ixgbe_test_staterr(IXGBE_RX_DESC(ring, ring->next_to_clean),
+				       IXGBE_RXD_STAT_DD))
+			return true;
+
+	return false;
+}
+
+static bool ixgbe_tx_pending(struct ixgbe_q_vector *q_vector)
+{
+	struct ixgbe_ring *ring;
+
+	ixgbe_for_each_ring(ring, q_vector->tx) {
+		struct ixgbe_tx_buffer *tx_buffer;
+		union ixgbe_adv_tx_desc *eop_desc;
+
+		tx_buffer = &ring->tx_buffer_info[ring->next_to_clean];
+		eop_desc = tx_buffer->next_to_watch;
+		if (!eop_desc)
+			continue;
+
+		/* prevent any other reads prior to eop_desc */
+		rmb();
+
+		if (eop_desc->wb.status & cpu_to_le32(IXGBE_TXD_STAT_DD))
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * ixgbe_busy_poll_recv - poll a q_vector for Rx on behalf of a socket
+ * @napi: napi struct of the q_vector
+ *
+ * Must be called with bottom halves disabled.  The q_vector is owned
+ * through NAPI_STATE_SCHED for the duration of the poll, so this never
+ * runs concurrently with ixgbe_poll().
+ **/
+static int ixgbe_busy_poll_recv(struct napi_struct *napi)
+{
+	struct ixgbe_q_vector *q_vector =
+				container_of(napi, struct ixgbe_q_vector, napi);
+	struct ixgbe_adapter *adapter = q_vector->adapter;
+	struct ixgbe_ring *ring;
+	int found = 0;
+
+	if (test_bit(__IXGBE_DOWN, &adapter->state))
+		return LL_FLUSH_FAILED;
+
+	if (!napi_schedule_prep(napi))
+		return LL_FLUSH_BUSY;
+
+	ixgbe_for_each_ring(ring, q_vector->rx) {
+		found = ixgbe_clean_rx_irq(q_vector, ring, 4);
+		if (found)
+			break;
+	}
+
+	/* don't leave anything sitting on the GRO list */
+	napi_gro_flush(napi);
+
+	/*
+	 * Give the vector back.  An interrupt that fired while we owned it
+	 * could not schedule NAPI, so either hand any work left over to
+	 * NAPI or re-enable the vector's interrupt ourselves.  Tx
+	 * completions are only cleaned by ixgbe_poll() and do not raise
+	 * a new interrupt once written back, so they count as work too.
+	 */
+	smp_mb__before_clear_bit();
+	clear_bit(NAPI_STATE_SCHED, &napi->state);
+	smp_mb__after_clear_bit();
+
+	if (ixgbe_rx_pending(q_vector) || ixgbe_tx_pending(q_vector))
+		napi_schedule(napi);
+	else if (!test_bit(__IXGBE_DOWN, &adapter->state))
+		ixgbe_irq_enable_queues(adapter, ((u64)1 << q_vector->v_idx));
+
+	return found;
+}
+#endif	/* CONFIG_NET_RX_BUSY_POLL */
+
 /**
  * ixgbe_request_msix_irqs - Initialize MSI-X interrupts
  * @adapter: board private structure
@@ -6681,6 +6789,34 @@ static int ixgbe_set_features(struct net_device *netdev,
 	return 0;
 }
 
+/**
+ * ixgbe_set_napi_coalesce - ITR update requested by the network core
+ * @napi: napi struct of the q_vector to update
+ * @usecs: interrupt interval in microseconds
+ * @frames: frame count limit, not supported by the hardware
+ *
+ * Only honoured while the ITR is in dynamic mode, a fixed interval set
+ * through ethtool is left alone.
+ **/
+static int ixgbe_set_napi_coalesce(struct napi_struct *napi,
+				   unsigned int usecs, unsigned int frames)
+{
+	struct ixgbe_q_vector *q_vector =
+				container_of(napi, struct ixgbe_q_vector, napi);
+	struct ixgbe_adapter *adapter = q_vector->adapter;
+
+	if (!(adapter->rx_itr_setting & 1))
+		return -EBUSY;
+
+	if (test_bit(__IXGBE_DOWN, &adapter->state))
+		return -ENETDOWN;
+
+	q_vector->itr = min_t(u32, usecs << 2, IXGBE_MAX_EITR);
+	ixgbe_write_eitr(q_vector);
+
+	return 0;
+}
+
 static const struct net_device_ops ixgbe_netdev_ops = {
 	.ndo_open		= ixgbe_open,
 	.ndo_stop		= ixgbe_close,
@@ -6706,6 +6842,10 @@ static const struct net_device_ops ixgbe_netdev_ops = {
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	.ndo_poll_controller	= ixgbe_netpoll,
 #endif
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	.ndo_busy_poll		= ixgbe_busy_poll_recv,
+#endif
+	.ndo_set_napi_coalesce	= ixgbe_set_napi_coalesce,
 #ifdef IXGBE_FCOE
 	.ndo_fcoe_ddp_setup = ixgbe_fcoe_ddp_get,
 	.ndo_fcoe_ddp_target = ixgbe_fcoe_ddp_target,
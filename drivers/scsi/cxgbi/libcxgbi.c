@@ -494,12 +494,13 @@ static struct cxgbi_sock *cxgbi_check_route(struct sockaddr *dst_addr)
 		goto err_out;
 	}
 	dst = &rt->dst;
-	n = dst_get_neighbour_noref(dst);
-	if (!n) {
+	n = dst_neigh_lookup(dst, &daddr->sin_addr.s_addr);
+	if (IS_ERR(n)) {
 		err = -ENODEV;
 		goto rel_rt;
 	}
 	ndev = n->dev;
+	neigh_release(n);
 
 	if (rt->rt_flags & (RTCF_MULTICAST | RTCF_BROADCAST)) {
 		pr_info("multi-cast route %pI4, port %u, dev %s.\n",
@@ -513,7 +514,7 @@ static struct cxgbi_sock *cxgbi_check_route(struct sockaddr *dst_addr)
 		ndev = ip_dev_find(&init_net, daddr->sin_addr.s_addr);
 		mtu = ndev->mtu;
 		pr_info("rt dev %s, loopback -> %s, mtu %u.\n",
-			n->dev->name, ndev->name, mtu);
+			dst->dev->name, ndev->name, mtu);
 	}
 
 	cdev = cxgbi_device_find_by_netdev(ndev, &port);
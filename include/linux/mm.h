@@ -207,6 +207,11 @@ struct vm_operations_struct {
 	void (*close)(struct vm_area_struct * area);
 	int (*fault)(struct vm_area_struct *vma, struct vm_fault *vmf);
 
+	/* map a whole huge page worth of page cache with a single pmd,
+	 * return VM_FAULT_FALLBACK to have ->fault map it by ptes */
+	int (*pmd_fault)(struct vm_area_struct *vma, unsigned long address,
+			 pmd_t *pmd, unsigned int flags);
+
 	/* notification that a previously read-only page is about to become
 	 * writable, if an error is returned it will cause a SIGBUS */
 	int (*page_mkwrite)(struct vm_area_struct *vma, struct vm_fault *vmf);
@@ -845,6 +850,7 @@ static inline int page_mapped(struct page *page)
 #define VM_FAULT_NOPAGE	0x0100	/* ->fault installed the pte, not return page */
 #define VM_FAULT_LOCKED	0x0200	/* ->fault locked the returned page */
 #define VM_FAULT_RETRY	0x0400	/* ->fault blocked, must retry */
+#define VM_FAULT_FALLBACK 0x0800	/* huge page fault failed, fall back to small */
 
 #define VM_FAULT_HWPOISON_LARGE_MASK 0xf000 /* encodes hpage index for large hwpoison */
 
@@ -984,6 +990,42 @@ static inline int fixup_user_fault(struct task_struct *tsk,
 }
 #endif
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, unsigned int flags);
+
+/*
+ * Changes to a vma that a speculative page fault must not miss (its
+ * range, flags, protection, or its removal from the mm) are made, with
+ * mmap_sem held for writing, between vma_write_begin() and
+ * vma_write_end().  A vma removed from its mm is left odd by
+ * vma_write_begin() alone, so speculative faults keep backing off it.
+ */
+static inline void vma_write_begin(struct vm_area_struct *vma)
+{
+	write_seqcount_begin(&vma->vm_sequence);
+}
+
+static inline void vma_write_end(struct vm_area_struct *vma)
+{
+	write_seqcount_end(&vma->vm_sequence);
+}
+#else
+static inline int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, unsigned int flags)
+{
+	return VM_FAULT_RETRY;
+}
+
+static inline void vma_write_begin(struct vm_area_struct *vma)
+{
+}
+
+static inline void vma_write_end(struct vm_area_struct *vma)
+{
+}
+#endif
+
 extern int make_pages_present(unsigned long addr, unsigned long end);
 extern int access_process_vm(struct task_struct *tsk, unsigned long addr, void *buf, int len, int write);
 extern int access_remote_vm(struct mm_struct *mm, unsigned long addr,
@@ -1050,10 +1092,38 @@ extern unsigned long move_page_tables(struct vm_area_struct *vma,
 extern unsigned long do_mremap(unsigned long addr,
 			       unsigned long old_len, unsigned long new_len,
 			       unsigned long flags, unsigned long new_addr);
+extern unsigned long change_protection(struct vm_area_struct *vma,
+			  unsigned long start, unsigned long end,
+			  pgprot_t newprot, int dirty_accountable,
+			  int prot_numa);
 extern int mprotect_fixup(struct vm_area_struct *vma,
 			  struct vm_area_struct **pprev, unsigned long start,
 			  unsigned long end, unsigned long newflags);
 
+#ifdef CONFIG_NUMA_BALANCING
+extern pgprot_t vma_prot_none(struct vm_area_struct *vma);
+extern unsigned long change_prot_numa(struct vm_area_struct *vma,
+			  unsigned long start, unsigned long end);
+
+/*
+ * A NUMA hinting PTE is a PROT_NONE PTE in a VMA that is otherwise
+ * accessible: change_prot_numa() made it so in order to learn which
+ * node touches the page next.
+ */
+static inline int pte_numa(struct vm_area_struct *vma, pte_t pte)
+{
+	if (!(vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC)))
+		return 0;
+
+	return pte_same(pte, pte_modify(pte, vma_prot_none(vma)));
+}
+#else
+static inline int pte_numa(struct vm_area_struct *vma, pte_t pte)
+{
+	return 0;
+}
+#endif
+
 /*
  * doesn't attempt to fault and will return short.
  */
@@ -1415,6 +1485,8 @@ extern void truncate_inode_pages_range(struct address_space *,
 
 /* generic vm_area_ops exported for stackable file systems */
 extern int filemap_fault(struct vm_area_struct *, struct vm_fault *);
+extern int filemap_pmd_fault(struct vm_area_struct *, unsigned long address,
+			     pmd_t *, unsigned int flags);
 
 /* mm/page-writeback.c */
 int write_one_page(struct page *page, int wait);
@@ -1426,6 +1498,8 @@ void task_dirty_inc(struct task_struct *tsk);
 
 int force_page_cache_readahead(struct address_space *mapping, struct file *filp,
 			pgoff_t offset, unsigned long nr_to_read);
+int page_cache_read_team(struct address_space *mapping, struct file *filp,
+			 pgoff_t index);
 
 void page_cache_sync_readahead(struct address_space *mapping,
 			       struct file_ra_state *ra,
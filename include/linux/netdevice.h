@@ -323,6 +323,27 @@ struct netdev_boot_setup {
 
 extern int __init netdev_boot_setup(char *str);
 
+/*
+ * State of the adaptive interrupt moderation run by the core on behalf
+ * of devices that implement ndo_set_napi_coalesce().  Only touched by
+ * the owner of NAPI_STATE_SCHED, so it needs no locking of its own.
+ */
+struct napi_dim {
+	ktime_t			start;		/* start of current sample */
+	u64			bytes;		/* bytes handled in sample */
+	u32			pkts;		/* packets handled in sample */
+	u32			events;		/* completions in sample */
+	u32			prev_bpms;	/* bytes per msec, last sample */
+	u32			prev_ppms;	/* packets per msec, last sample */
+	u32			prev_epms;	/* events per msec, last sample */
+	u8			profile_ix;
+	u8			tune_state;
+	u8			steps_left;
+	u8			steps_right;
+	u8			tired;
+	struct work_struct	work;
+};
+
 /*
  * Structure for NAPI scheduling similar to tasklet but with weighting
  */
@@ -344,17 +365,23 @@ struct napi_struct {
 #endif
 
 	unsigned int		gro_count;
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	unsigned int		napi_id;
+	struct hlist_node	napi_hash_node;
+#endif
 
 	struct net_device	*dev;
 	struct list_head	dev_list;
 	struct sk_buff		*gro_list;
 	struct sk_buff		*skb;
+	struct napi_dim		dim;
 };
 
 enum {
 	NAPI_STATE_SCHED,	/* Poll is scheduled */
 	NAPI_STATE_DISABLE,	/* Disable pending */
 	NAPI_STATE_NPSVC,	/* Netpoll - don't dequeue from poll_list */
+	NAPI_STATE_HASHED,	/* In NAPI hash (busy polling possible) */
 };
 
 enum gro_result {
@@ -470,6 +497,63 @@ static inline bool napi_reschedule(struct napi_struct *napi)
 extern void __napi_complete(struct napi_struct *n);
 extern void napi_complete(struct napi_struct *n);
 
+/**
+ *	napi_complete_done - NAPI processing complete
+ *	@n: napi context
+ *	@work_done: number of packets processed by this poll
+ *
+ * Like napi_complete(), but also reports the work done in the last
+ * poll so that adaptive interrupt moderation sees the packet rate.
+ */
+extern void napi_complete_done(struct napi_struct *n, int work_done);
+
+/**
+ *	napi_dim_account - report traffic to adaptive interrupt moderation
+ *	@n: napi context, owned by the caller
+ *	@pkts: packets handled outside of the budgeted work, e.g. transmit
+ *	       completions
+ *	@bytes: bytes handled by this poll, received and transmitted
+ *
+ * Called from the poll routine of drivers whose NAPI context does more
+ * than the work it reports through napi_complete_done().
+ */
+static inline void napi_dim_account(struct napi_struct *n,
+				    unsigned int pkts, unsigned int bytes)
+{
+	n->dim.pkts += pkts;
+	n->dim.bytes += bytes;
+}
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/**
+ *	napi_hash_add - add a NAPI to global hashtable
+ *	@napi: napi context
+ *
+ * Generate a new napi_id and store a @napi under it in napi_hash.
+ * Used for busy polling.
+ */
+extern void napi_hash_add(struct napi_struct *napi);
+
+/**
+ *	napi_hash_del - remove a NAPI from global table
+ *	@napi: napi context
+ *
+ * Warning: caller must observe an RCU grace period before freeing
+ * memory containing @napi.
+ */
+extern void napi_hash_del(struct napi_struct *napi);
+
+extern struct napi_struct *napi_by_id(unsigned int napi_id);
+#else
+static inline void napi_hash_add(struct napi_struct *napi)
+{
+}
+
+static inline void napi_hash_del(struct napi_struct *napi)
+{
+}
+#endif
+
 /**
  *	napi_disable - prevent NAPI from scheduling
  *	@n: napi context
@@ -819,6 +903,23 @@ struct netdev_fcoe_hbainfo {
  *
  * void (*ndo_poll_controller)(struct net_device *dev);
  *
+ * int (*ndo_busy_poll)(struct napi_struct *dev);
+ *	Called from a socket to poll a device queue for new packets
+ *	without waiting for an interrupt.  Runs with bottom halves
+ *	disabled.  Returns the number of packets cleaned, LL_FLUSH_BUSY if
+ *	the queue is owned by someone else, or LL_FLUSH_FAILED if the
+ *	device cannot be polled right now.
+ *
+ * int (*ndo_set_napi_coalesce)(struct napi_struct *napi,
+ *				unsigned int usecs, unsigned int frames);
+ *	Called by the core adaptive interrupt moderation to change the
+ *	interrupt coalescing of the queue(s) served by @napi to at most
+ *	@usecs microseconds or @frames frames, whichever comes first.
+ *	Devices without a frame count limit may ignore @frames.  Runs
+ *	from a workqueue without RTNL held, and is only used while
+ *	IFF_NAPI_DIM is set on the device.  The flag is off by default,
+ *	drivers set it when adaptive-rx is turned on through ethtool.
+ *
  *	SR-IOV management functions.
  * int (*ndo_set_vf_mac)(struct net_device *dev, int vf, u8* mac);
  * int (*ndo_set_vf_vlan)(struct net_device *dev, int vf, u16 vlan, u8 qos);
@@ -945,6 +1046,12 @@ struct net_device_ops {
 						     struct netpoll_info *info);
 	void			(*ndo_netpoll_cleanup)(struct net_device *dev);
 #endif
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	int			(*ndo_busy_poll)(struct napi_struct *dev);
+#endif
+	int			(*ndo_set_napi_coalesce)(struct napi_struct *napi,
+							 unsigned int usecs,
+							 unsigned int frames);
 	int			(*ndo_set_vf_mac)(struct net_device *dev,
 						  int queue, u8 *mac);
 	int			(*ndo_set_vf_vlan)(struct net_device *dev,
@@ -1486,6 +1593,9 @@ struct napi_gro_cb {
 
 	/* Free the skb? */
 	int free;
+
+	/* Set once a tunnel layer has been stripped, to stop nesting. */
+	int encap_mark;
 };
 
 #define NAPI_GRO_CB(skb) ((struct napi_gro_cb *)(skb)->cb)
@@ -1502,7 +1612,7 @@ struct packet_type {
 	int			(*gso_send_check)(struct sk_buff *skb);
 	struct sk_buff		**(*gro_receive)(struct sk_buff **head,
 					       struct sk_buff *skb);
-	int			(*gro_complete)(struct sk_buff *skb);
+	int			(*gro_complete)(struct sk_buff *skb, int nhoff);
 	void			*af_packet_priv;
 	struct list_head	list;
 };
@@ -1686,6 +1796,35 @@ static inline void *skb_gro_network_header(struct sk_buff *skb)
 	       skb_network_offset(skb);
 }
 
+/*
+ * Header of the held packet @p that sits where @skb is being looked at
+ * @off bytes into its data.  Held packets have all their headers pulled
+ * and may have had their link layer header pulled already, so work from
+ * the MAC header, which is the same length in both.
+ */
+static inline void *skb_gro_held_header(struct sk_buff *p,
+					 const struct sk_buff *skb,
+					 unsigned int off)
+{
+	return skb_mac_header(p) + (skb->data - skb_mac_header(skb)) + off;
+}
+
+/*
+ * Tunnels hand their inner packet to protocols that check the
+ * checksum from skb->csum.  Whatever the device validated only covers
+ * the outer headers, so unless it provided a full checksum, compute
+ * one here over everything from the outer network header on.
+ */
+static inline void skb_gro_tunnel_csum(struct sk_buff *skb)
+{
+	if (skb->ip_summed != CHECKSUM_COMPLETE) {
+		int off = skb_network_offset(skb);
+
+		skb->csum = skb_checksum(skb, off, skb->len - off, 0);
+		skb->ip_summed = CHECKSUM_COMPLETE;
+	}
+}
+
 static inline int dev_hard_header(struct sk_buff *skb, struct net_device *dev,
 				  unsigned short type,
 				  const void *daddr, const void *saddr,
@@ -2589,6 +2728,10 @@ extern int netdev_set_bond_master(struct net_device *dev,
 extern int skb_checksum_help(struct sk_buff *skb);
 extern struct sk_buff *skb_gso_segment(struct sk_buff *skb,
 	netdev_features_t features);
+extern struct packet_type *dev_find_offload(__be16 type);
+extern int skb_network_gso_send_check(struct sk_buff *skb, __be16 type);
+extern struct sk_buff *skb_network_gso_segment(struct sk_buff *skb,
+	netdev_features_t features, __be16 type);
 #ifdef CONFIG_BUG
 extern void netdev_rx_csum_fault(struct net_device *dev);
 #else
@@ -2642,6 +2785,9 @@ static inline bool net_gso_ok(netdev_features_t features, int gso_type)
 	BUILD_BUG_ON(SKB_GSO_TCP_ECN != (NETIF_F_TSO_ECN >> NETIF_F_GSO_SHIFT));
 	BUILD_BUG_ON(SKB_GSO_TCPV6   != (NETIF_F_TSO6 >> NETIF_F_GSO_SHIFT));
 	BUILD_BUG_ON(SKB_GSO_FCOE    != (NETIF_F_FSO >> NETIF_F_GSO_SHIFT));
+	BUILD_BUG_ON(SKB_GSO_UDP_L4  != (NETIF_F_GSO_UDP_L4 >> NETIF_F_GSO_SHIFT));
+	BUILD_BUG_ON(SKB_GSO_GRE     != (NETIF_F_GSO_GRE >> NETIF_F_GSO_SHIFT));
+	BUILD_BUG_ON(SKB_GSO_IPIP    != (NETIF_F_GSO_IPIP >> NETIF_F_GSO_SHIFT));
 
 	return (features & feature) == feature;
 }
@@ -404,13 +404,10 @@ struct xt_table_info {
 	unsigned int stacksize;
 	unsigned int __percpu *stackptr;
 	void ***jumpstack;
-	/* ipt_entry tables: one per CPU */
-	/* Note : this field MUST be the last one, see XT_TABLE_INFO_SZ */
-	void *entries[1];
+	/* ipt_entry table, shared by all CPUs; the rule counters are
+	 * kept per CPU, see xt_percpu_counter_alloc() */
+	void *entries;
 };
-
-#define XT_TABLE_INFO_SZ (offsetof(struct xt_table_info, entries) \
-			  + nr_cpu_ids * sizeof(char *))
 extern int xt_register_target(struct xt_target *target);
 extern void xt_unregister_target(struct xt_target *target);
 extern int xt_register_targets(struct xt_target *target, unsigned int n);
@@ -512,6 +509,55 @@ static inline void xt_write_recseq_end(unsigned int addend)
 	__this_cpu_add(xt_recseq.sequence, addend);
 }
 
+/*
+ * The rule blob is shared by all CPUs and never written by the packet
+ * path. On SMP, entry->counters.pcnt holds the address of the real,
+ * per-cpu, counters of the rule instead; on UP the counters in the
+ * entry are used directly.
+ *
+ * xt_percpu_counter_alloc() returns the address of the percpu counter,
+ * or 0 on UP. Bytes and packets are kept in the same cache line.
+ * Callers must use IS_ERR_VALUE() to check for errors.
+ */
+static inline u64 xt_percpu_counter_alloc(void)
+{
+	if (nr_cpu_ids > 1) {
+		void __percpu *res = __alloc_percpu(sizeof(struct xt_counters),
+						    sizeof(struct xt_counters));
+
+		if (res == NULL)
+			return (u64) -ENOMEM;
+
+		return (u64) (__force unsigned long) res;
+	}
+
+	return 0;
+}
+
+static inline void xt_percpu_counter_free(u64 pcnt)
+{
+	if (nr_cpu_ids > 1)
+		free_percpu((void __percpu *) (unsigned long) pcnt);
+}
+
+static inline struct xt_counters *
+xt_get_this_cpu_counter(struct xt_counters *cnt)
+{
+	if (nr_cpu_ids > 1)
+		return this_cpu_ptr((void __percpu *) (unsigned long) cnt->pcnt);
+
+	return cnt;
+}
+
+static inline struct xt_counters *
+xt_get_per_cpu_counter(struct xt_counters *cnt, unsigned int cpu)
+{
+	if (nr_cpu_ids > 1)
+		return per_cpu_ptr((void __percpu *) (unsigned long) cnt->pcnt, cpu);
+
+	return cnt;
+}
+
 /*
  * This helper is performance critical and must be inlined
  */
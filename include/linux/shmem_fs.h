@@ -32,6 +32,7 @@ struct shmem_sb_info {
 	gid_t gid;		    /* Mount gid for root directory */
 	umode_t mode;		    /* Mount mode for root directory */
 	struct mempolicy *mpol;     /* default memory policy for mappings */
+	bool huge;		    /* Map files with huge pages if possible */
 };
 
 static inline struct shmem_inode_info *SHMEM_I(struct inode *inode)
@@ -53,6 +54,12 @@ extern struct page *shmem_read_mapping_page_gfp(struct address_space *mapping,
 					pgoff_t index, gfp_t gfp_mask);
 extern void shmem_truncate_range(struct inode *inode, loff_t start, loff_t end);
 extern int shmem_unuse(swp_entry_t entry, struct page *page);
+extern bool shmem_mapping(struct address_space *mapping);
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+extern bool shmem_huge_enabled(struct vm_area_struct *vma);
+extern int shmem_collapse_team(struct address_space *mapping, pgoff_t index,
+			       int max_holes);
+#endif
 
 static inline struct page *shmem_read_mapping_page(
 				struct address_space *mapping, pgoff_t index)
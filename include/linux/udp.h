@@ -29,6 +29,8 @@ struct udphdr {
 /* UDP socket options */
 #define UDP_CORK	1	/* Never send partially complete segments */
 #define UDP_ENCAP	100	/* Set the socket to accept encapsulated packets */
+#define UDP_SEGMENT	103	/* Set GSO segmentation size */
+#define UDP_GRO		104	/* This socket can receive UDP GRO packets */
 
 /* UDP encapsulation types */
 #define UDP_ENCAP_ESPINUDP_NON_IKE	1 /* draft-ietf-ipsec-nat-t-ike-00/01 */
@@ -76,11 +78,27 @@ struct udp_sock {
 #define UDPLITE_SEND_CC  0x2  		/* set via udplite setsockopt         */
 #define UDPLITE_RECV_CC  0x4		/* set via udplite setsocktopt        */
 	__u8		 pcflag;        /* marks socket as UDP-Lite if > 0    */
-	__u8		 unused[3];
+	__u8		 gro_enabled;	/* Can receive GRO'd datagrams */
+	__u16		 gso_size;	/* Payload size of GSO'd datagrams */
 	/*
 	 * For encapsulation sockets.
 	 */
 	int (*encap_rcv)(struct sock *sk, struct sk_buff *skb);
+	/*
+	 * GRO of the packets carried by an encapsulation socket: called
+	 * with the UDP header pulled and skb->csum covering the payload.
+	 */
+	struct sk_buff **(*gro_receive)(struct sock *sk,
+					struct sk_buff **head,
+					struct sk_buff *skb);
+	int (*gro_complete)(struct sock *sk, struct sk_buff *skb,
+			    int nhoff);
+
+	/*
+	 * Datagrams moved off sk_receive_queue in one go by the reader,
+	 * so that recvmsg() does not contend with the softirq producers.
+	 */
+	struct sk_buff_head	 reader_queue ____cacheline_aligned_in_smp;
 };
 
 static inline struct udp_sock *udp_sk(const struct sock *sk)
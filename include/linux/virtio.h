@@ -16,6 +16,7 @@
  * @name: the name of this virtqueue (mainly for debugging)
  * @vdev: the virtio device this queue was created for.
  * @priv: a pointer for the virtqueue implementation to use.
+ * @index: the zero-based ordinal number for this queue.
  */
 struct virtqueue {
 	struct list_head list;
@@ -23,6 +24,7 @@ struct virtqueue {
 	const char *name;
 	struct virtio_device *vdev;
 	void *priv;
+	unsigned int index;
 };
 
 int virtqueue_add_buf(struct virtqueue *vq,
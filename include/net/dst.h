@@ -70,13 +70,14 @@ struct dst_entry {
 #else
 	__u32			__pad2;
 #endif
+	int			pending_confirm;	/* no neighbour bound yet */
 
 	/*
 	 * Align __refcnt to a 64 bytes alignment
 	 * (L1_CACHE_SIZE would be too much)
 	 */
 #ifdef CONFIG_64BIT
-	long			__pad_to_align_refcnt[2];
+	long			__pad_to_align_refcnt[1];
 #endif
 	/*
 	 * __refcnt wants to be on a different cache line from
@@ -338,6 +339,10 @@ static inline void __skb_tunnel_rx(struct sk_buff *skb, struct net_device *dev)
 	skb_set_queue_mapping(skb, 0);
 	skb_dst_drop(skb);
 	nf_reset(skb);
+
+	/* A packet merged by GRO is no longer inside the tunnel. */
+	if (skb_is_gso(skb))
+		skb_shinfo(skb)->gso_type &= ~(SKB_GSO_GRE | SKB_GSO_IPIP);
 }
 
 /**
@@ -400,11 +405,24 @@ static inline void dst_confirm(struct dst_entry *dst)
 
 		rcu_read_lock();
 		n = dst_get_neighbour_noref(dst);
-		neigh_confirm(n);
+		if (n)
+			neigh_confirm(n);
+		else
+			dst->pending_confirm = 1;
 		rcu_read_unlock();
 	}
 }
 
+/* Hand a confirmation made while no neighbour was bound to @n */
+static inline void dst_neigh_confirm(struct dst_entry *dst,
+				     struct neighbour *n)
+{
+	if (unlikely(dst->pending_confirm)) {
+		n->confirmed = jiffies;
+		dst->pending_confirm = 0;
+	}
+}
+
 static inline struct neighbour *dst_neigh_lookup(const struct dst_entry *dst, const void *daddr)
 {
 	return dst->ops->neigh_lookup(dst, daddr);
@@ -61,6 +61,7 @@ struct inet_connection_sock_af_ops {
 	void	    (*addr2sockaddr)(struct sock *sk, struct sockaddr *);
 	int	    (*bind_conflict)(const struct sock *sk,
 				     const struct inet_bind_bucket *tb);
+	int	    (*recv_error)(struct sock *sk, struct msghdr *msg, int len);
 };
 
 /** inet_connection_sock - INET connection oriented sock
@@ -244,6 +245,10 @@ extern struct request_sock *inet_csk_search_req(const struct sock *sk,
 						const __be16 rport,
 						const __be32 raddr,
 						const __be32 laddr);
+extern bool inet_csk_reqsk_pending(struct sock *sk,
+				   const __be16 rport,
+				   const __be32 raddr,
+				   const __be32 laddr);
 extern int inet_csk_bind_conflict(const struct sock *sk,
 				  const struct inet_bind_bucket *tb);
 extern int inet_csk_get_port(struct sock *sk, unsigned short snum);
@@ -266,20 +271,6 @@ extern void inet_csk_reqsk_queue_hash_add(struct sock *sk,
 					  struct request_sock *req,
 					  unsigned long timeout);
 
-static inline void inet_csk_reqsk_queue_removed(struct sock *sk,
-						struct request_sock *req)
-{
-	if (reqsk_queue_removed(&inet_csk(sk)->icsk_accept_queue, req) == 0)
-		inet_csk_delete_keepalive_timer(sk);
-}
-
-static inline void inet_csk_reqsk_queue_added(struct sock *sk,
-					      const unsigned long timeout)
-{
-	if (reqsk_queue_added(&inet_csk(sk)->icsk_accept_queue) == 0)
-		inet_csk_reset_keepalive_timer(sk, timeout);
-}
-
 static inline int inet_csk_reqsk_queue_len(const struct sock *sk)
 {
 	return reqsk_queue_len(&inet_csk(sk)->icsk_accept_queue);
@@ -299,7 +290,8 @@ static inline void inet_csk_reqsk_queue_unlink(struct sock *sk,
 					       struct request_sock *req,
 					       struct request_sock **prev)
 {
-	reqsk_queue_unlink(&inet_csk(sk)->icsk_accept_queue, req, prev);
+	if (reqsk_queue_unlink(&inet_csk(sk)->icsk_accept_queue, req, prev) == 0)
+		inet_csk_delete_keepalive_timer(sk);
 }
 
 static inline void inet_csk_reqsk_queue_drop(struct sock *sk,
@@ -307,7 +299,6 @@ static inline void inet_csk_reqsk_queue_drop(struct sock *sk,
 					     struct request_sock **prev)
 {
 	inet_csk_reqsk_queue_unlink(sk, req, prev);
-	inet_csk_reqsk_queue_removed(sk, req);
 	reqsk_free(req);
 }
 
@@ -40,6 +40,12 @@ struct inet_peer {
 	u32			pmtu_orig;
 	u32			pmtu_learned;
 	struct inetpeer_addr_base redirect_learned;
+	/* TCP Fast Open client cache, see tcp_fastopen.c */
+	u16			tfo_mss;
+	u8			tfo_cookie_len;
+	u8			tfo_syn_loss;
+	unsigned long		tfo_last_syn_loss;
+	u8			tfo_cookie[16];	/* TCP_FASTOPEN_COOKIE_MAX */
 	struct list_head	gc_list;
 	/*
 	 * Once inet_peer is queued for deletion (refcnt == -1), following fields
@@ -45,12 +45,48 @@ struct ip_tunnel_prl_entry {
 	struct rcu_head			rcu_head;
 };
 
+/*
+ * Get a packet ready to have a tunnel header added.  GSO packets are
+ * left for the device or skb_gso_segment() to split, everything else
+ * has its checksum done now as the outer header hides it from the
+ * device.
+ */
+static inline int iptunnel_handle_offloads(struct sk_buff *skb, int gso_type)
+{
+	int err;
+
+	if (skb_is_gso(skb)) {
+		if (skb_header_cloned(skb)) {
+			err = pskb_expand_head(skb, 0, 0, GFP_ATOMIC);
+			if (unlikely(err))
+				return err;
+		}
+		skb_shinfo(skb)->gso_type |= gso_type;
+		return 0;
+	}
+
+	if (skb->ip_summed == CHECKSUM_PARTIAL)
+		return skb_checksum_help(skb);
+
+	return 0;
+}
+
+/*
+ * GSO packets keep CHECKSUM_PARTIAL for the inner header and reserve
+ * one IP ID for each segment they will be split into.
+ */
 #define __IPTUNNEL_XMIT(stats1, stats2) do {				\
 	int err;							\
 	int pkt_len = skb->len - skb_transport_offset(skb);		\
 									\
-	skb->ip_summed = CHECKSUM_NONE;					\
-	ip_select_ident(iph, &rt->dst, NULL);				\
+	if (skb_is_gso(skb)) {						\
+		ip_select_ident_more(iph, &rt->dst, NULL,		\
+				     skb_shinfo(skb)->gso_segs ?	\
+				     skb_shinfo(skb)->gso_segs - 1 : 0);\
+	} else {							\
+		skb->ip_summed = CHECKSUM_NONE;				\
+		ip_select_ident(iph, &rt->dst, NULL);			\
+	}								\
 									\
 	err = ip_local_out(skb);					\
 	if (likely(net_xmit_eval(err) == 0)) {				\
@@ -64,4 +100,11 @@ struct ip_tunnel_prl_entry {
 
 #define IPTUNNEL_XMIT() __IPTUNNEL_XMIT(txq, stats)
 
+extern struct sk_buff **ipip_gro_receive(struct sk_buff **head,
+					 struct sk_buff *skb);
+extern int ipip_gro_complete(struct sk_buff *skb, int nhoff);
+extern int ipip_gso_send_check(struct sk_buff *skb);
+extern struct sk_buff *ipip_gso_segment(struct sk_buff *skb,
+					netdev_features_t features);
+
 #endif
@@ -106,6 +106,19 @@ struct listen_sock {
 	struct request_sock	*syn_table[0];
 };
 
+/*
+ * For a TCP Fast Open listener -
+ *	lock - protects the access to all the reqsk, which is co-owned by
+ *		the listener and the child socket.
+ *	qlen - pending TFO requests (still in TCP_SYN_RECV).
+ *	max_qlen - max TFO reqs allowed before TFO is disabled.
+ */
+struct fastopen_queue {
+	spinlock_t	lock;
+	int		qlen;		/* # of pending (TCP_SYN_RECV) reqs */
+	int		max_qlen;	/* != 0 iff TFO is currently enabled */
+};
+
 /** struct request_sock_queue - queue of request_socks
  *
  * @rskq_accept_head - FIFO head of established children
@@ -113,14 +126,17 @@ struct listen_sock {
  * @rskq_defer_accept - User waits for some data after accept()
  * @syn_wait_lock - serializer
  *
- * %syn_wait_lock is necessary only to avoid proc interface having to grab the main
+ * %syn_wait_lock is necessary to avoid proc interface having to grab the main
  * lock sock while browsing the listening hash (otherwise it's deadlock prone).
  *
- * This lock is acquired in read mode only from listening_get_next() seq_file
- * op and it's acquired in write mode _only_ from code that is actively
- * changing rskq_accept_head. All readers that are holding the master sock lock
- * don't need to grab this lock in read mode too as rskq_accept_head. writes
- * are always protected from the main sock lock.
+ * It also serializes the SYN table against the lockless SYN path (see
+ * tcp_v4_syn_nolock()), which adds requests without holding the main sock
+ * lock. Hence every change to the SYN table and to the qlen/qlen_young
+ * counters is done with this lock held in write mode. Requests are only
+ * ever added at the head of a chain, and only removed with the main sock
+ * lock held, so readers holding the main sock lock can still walk the
+ * chains without grabbing this lock in read mode. listen_opt itself is
+ * freed only after an RCU grace period, see reqsk_queue_destroy().
  */
 struct request_sock_queue {
 	struct request_sock	*rskq_accept_head;
@@ -129,6 +145,12 @@ struct request_sock_queue {
 	u8			rskq_defer_accept;
 	/* 3 bytes hole, try to pack */
 	struct listen_sock	*listen_opt;
+	struct fastopen_queue	*fastopenq; /* This is non-NULL iff TFO has been
+					     * enabled on this listener. Check
+					     * max_qlen != 0 in fastopen_queue
+					     * to determine if TFO is enabled
+					     * right at this moment.
+					     */
 };
 
 extern int reqsk_queue_alloc(struct request_sock_queue *queue,
@@ -151,13 +173,28 @@ static inline int reqsk_queue_empty(struct request_sock_queue *queue)
 	return queue->rskq_accept_head == NULL;
 }
 
-static inline void reqsk_queue_unlink(struct request_sock_queue *queue,
-				      struct request_sock *req,
-				      struct request_sock **prev_req)
+/*
+ * Unlink @req from the SYN table and account for it, returns the number
+ * of requests left. @prev_req may be stale if new requests were added at
+ * the head of its chain since it was looked up.
+ */
+static inline int reqsk_queue_unlink(struct request_sock_queue *queue,
+				     struct request_sock *req,
+				     struct request_sock **prev_req)
 {
+	struct listen_sock *lopt = queue->listen_opt;
+	int qlen;
+
 	write_lock(&queue->syn_wait_lock);
+	while (*prev_req != req)
+		prev_req = &(*prev_req)->dl_next;
 	*prev_req = req->dl_next;
+	if (req->retrans == 0)
+		--lopt->qlen_young;
+	qlen = --lopt->qlen;
 	write_unlock(&queue->syn_wait_lock);
+
+	return qlen;
 }
 
 static inline void reqsk_queue_add(struct request_sock_queue *queue,
@@ -190,69 +227,63 @@ static inline struct request_sock *reqsk_queue_remove(struct request_sock_queue
 	return req;
 }
 
-static inline struct sock *reqsk_queue_get_child(struct request_sock_queue *queue,
-						 struct sock *parent)
-{
-	struct request_sock *req = reqsk_queue_remove(queue);
-	struct sock *child = req->sk;
-
-	WARN_ON(child == NULL);
-
-	sk_acceptq_removed(parent);
-	__reqsk_free(req);
-	return child;
-}
-
-static inline int reqsk_queue_removed(struct request_sock_queue *queue,
-				      struct request_sock *req)
-{
-	struct listen_sock *lopt = queue->listen_opt;
-
-	if (req->retrans == 0)
-		--lopt->qlen_young;
-
-	return --lopt->qlen;
-}
-
-static inline int reqsk_queue_added(struct request_sock_queue *queue)
-{
-	struct listen_sock *lopt = queue->listen_opt;
-	const int prev_qlen = lopt->qlen;
-
-	lopt->qlen_young++;
-	lopt->qlen++;
-	return prev_qlen;
-}
+extern void reqsk_fastopen_remove(struct sock *sk,
+				  struct request_sock *req);
 
+/*
+ * The following may be called without the main sock lock, from the
+ * lockless SYN path, where listen_opt can go away under us.
+ */
 static inline int reqsk_queue_len(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt != NULL ? queue->listen_opt->qlen : 0;
+	const struct listen_sock *lopt = ACCESS_ONCE(queue->listen_opt);
+
+	return lopt != NULL ? lopt->qlen : 0;
 }
 
 static inline int reqsk_queue_len_young(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt->qlen_young;
+	const struct listen_sock *lopt = ACCESS_ONCE(queue->listen_opt);
+
+	return lopt != NULL ? lopt->qlen_young : 0;
 }
 
 static inline int reqsk_queue_is_full(const struct request_sock_queue *queue)
 {
-	return queue->listen_opt->qlen >> queue->listen_opt->max_qlen_log;
+	const struct listen_sock *lopt = ACCESS_ONCE(queue->listen_opt);
+
+	return lopt != NULL ? lopt->qlen >> lopt->max_qlen_log : 0;
 }
 
-static inline void reqsk_queue_hash_req(struct request_sock_queue *queue,
-					u32 hash, struct request_sock *req,
-					unsigned long timeout)
+/*
+ * Add @req to chain @hash of @lopt, which the caller looked up from the
+ * queue without necessarily holding the main sock lock. Returns the
+ * number of requests queued before, or -1 if @lopt is no longer the SYN
+ * table of the queue (the listener was closed meanwhile).
+ */
+static inline int reqsk_queue_hash_req(struct request_sock_queue *queue,
+				       struct listen_sock *lopt,
+				       u32 hash, struct request_sock *req,
+				       unsigned long timeout)
 {
-	struct listen_sock *lopt = queue->listen_opt;
+	int prev_qlen = -1;
 
 	req->expires = jiffies + timeout;
 	req->retrans = 0;
 	req->sk = NULL;
-	req->dl_next = lopt->syn_table[hash];
 
 	write_lock(&queue->syn_wait_lock);
-	lopt->syn_table[hash] = req;
+	if (likely(queue->listen_opt == lopt)) {
+		req->dl_next = lopt->syn_table[hash];
+		/* lockless readers of the chain must see req->dl_next */
+		smp_wmb();
+		lopt->syn_table[hash] = req;
+		prev_qlen = lopt->qlen++;
+		lopt->qlen_young++;
+	}
 	write_unlock(&queue->syn_wait_lock);
+
+	return prev_qlen;
 }
 
 #endif /* _REQUEST_SOCK_H */
@@ -182,6 +182,7 @@ extern void udp_err(struct sk_buff *, u32);
 extern int udp_sendmsg(struct kiocb *iocb, struct sock *sk,
 			    struct msghdr *msg, size_t len);
 extern void udp_flush_pending_frames(struct sock *sk);
+extern int udp_init_sock(struct sock *sk);
 extern int udp_rcv(struct sk_buff *skb);
 extern int udp_ioctl(struct sock *sk, int cmd, unsigned long arg);
 extern int udp_disconnect(struct sock *sk, int flags);
@@ -192,6 +193,9 @@ extern int udp_lib_getsockopt(struct sock *sk, int level, int optname,
 extern int udp_lib_setsockopt(struct sock *sk, int level, int optname,
 			      char __user *optval, unsigned int optlen,
 			      int (*push_pending_frames)(struct sock *));
+extern struct sk_buff *__skb_recv_udp(struct sock *sk, unsigned int flags,
+				      int noblock, int *peeked, int *off,
+				      int *err);
 extern struct sock *udp4_lib_lookup(struct net *net, __be32 saddr, __be16 sport,
 				    __be32 daddr, __be16 dport,
 				    int dif);
@@ -205,6 +209,21 @@ extern struct sock *__udp6_lib_lookup(struct net *net, const struct in6_addr *sa
 				    const struct in6_addr *daddr, __be16 dport,
 				    int dif, struct udp_table *tbl);
 
+/*
+ * A GRO'd datagram is delivered as one buffer holding several datagrams
+ * of gso_size bytes each (the last one may be shorter), tell the reader.
+ */
+static inline void udp_cmsg_recv(struct msghdr *msg, struct sock *sk,
+				 struct sk_buff *skb)
+{
+	int gso_size;
+
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4) {
+		gso_size = skb_shinfo(skb)->gso_size;
+		put_cmsg(msg, SOL_UDP, UDP_GRO, sizeof(gso_size), &gso_size);
+	}
+}
+
 /*
  * 	SNMP statistics for UDP and UDP-Lite
  */
@@ -267,4 +286,9 @@ extern void udp_init(void);
 extern int udp4_ufo_send_check(struct sk_buff *skb);
 extern struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 	netdev_features_t features);
+extern struct sk_buff *__udp_gso_segment(struct sk_buff *gso_skb,
+	netdev_features_t features);
+extern struct sk_buff **udp4_gro_receive(struct sk_buff **head,
+	struct sk_buff *skb);
+extern int udp4_gro_complete(struct sk_buff *skb, int nhoff);
 #endif	/* _UDP_H */
@@ -34,6 +34,7 @@
 #include <linux/hardirq.h> /* for BUG_ON(!in_atomic()) only */
 #include <linux/memcontrol.h>
 #include <linux/cleancache.h>
+#include <linux/rmap.h>
 #include "internal.h"
 
 /*
@@ -717,6 +718,32 @@ out:
 }
 EXPORT_SYMBOL(find_get_page);
 
+/**
+ * page_cache_range_empty - check whether a range of the page cache is empty
+ * @mapping: the address_space to search
+ * @index: the first page index of the range
+ * @nr_pages: the number of pages in the range
+ *
+ * Returns true if nothing at all, not even a shmem swap entry, is cached
+ * at @index .. @index + @nr_pages - 1.  The answer can be stale by the
+ * time the caller looks at it.
+ */
+bool page_cache_range_empty(struct address_space *mapping, pgoff_t index,
+			    unsigned long nr_pages)
+{
+	struct radix_tree_iter iter;
+	void **slot;
+	bool empty = true;
+
+	rcu_read_lock();
+	radix_tree_for_each_slot(slot, &mapping->page_tree, &iter, index) {
+		empty = iter.index >= index + nr_pages;
+		break;
+	}
+	rcu_read_unlock();
+	return empty;
+}
+
 /**
  * find_lock_page - locate, pin and lock a pagecache page
  * @mapping: the address_space to search
@@ -1751,8 +1778,52 @@ page_not_uptodate:
 }
 EXPORT_SYMBOL(filemap_fault);
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/**
+ * filemap_pmd_fault - map a huge page worth of a file with a single pmd
+ * @vma:	vma in which the fault was taken
+ * @address:	faulting address
+ * @pmd:	the empty pmd covering @address
+ * @flags:	FAULT_FLAG_xxx flags
+ *
+ * If nothing of the huge page sized range of the file behind @address is
+ * cached yet, read all of it into a team of physically contiguous pages,
+ * then map the team with a huge pmd.  Only mappings which can't be
+ * written are mapped huge, so that dirty pages are never mapped by a pmd
+ * and writeback keeps working a small page at a time.
+ */
+int filemap_pmd_fault(struct vm_area_struct *vma, unsigned long address,
+		      pmd_t *pmd, unsigned int flags)
+{
+	struct file *file = vma->vm_file;
+	struct address_space *mapping = file->f_mapping;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pgoff_t index;
+	int ret = 0;
+
+	if (!transparent_hugepage_enabled(vma) || (vma->vm_flags & VM_WRITE))
+		return VM_FAULT_FALLBACK;
+	if (!transhuge_file_vma_suitable(vma, haddr, flags))
+		return VM_FAULT_FALLBACK;
+
+	index = linear_page_index(vma, haddr);
+	if (page_cache_range_empty(mapping, index, HPAGE_PMD_NR)) {
+		if (!page_cache_read_team(mapping, file, index))
+			return VM_FAULT_FALLBACK;
+		count_vm_event(PGMAJFAULT);
+		mem_cgroup_count_vm_event(vma->vm_mm, PGMAJFAULT);
+		ret = VM_FAULT_MAJOR;
+	}
+	return ret | do_huge_pmd_file_page(vma, address, pmd, flags);
+}
+EXPORT_SYMBOL(filemap_pmd_fault);
+#endif
+
 const struct vm_operations_struct generic_file_vm_ops = {
 	.fault		= filemap_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.pmd_fault	= filemap_pmd_fault,
+#endif
 };
 
 /* This is used for a general mmap of a disk file */
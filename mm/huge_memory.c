@@ -17,6 +17,9 @@
 #include <linux/khugepaged.h>
 #include <linux/freezer.h>
 #include <linux/mman.h>
+#include <linux/file.h>
+#include <linux/pagemap.h>
+#include <linux/shmem_fs.h>
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
 #include "internal.h"
@@ -748,6 +751,175 @@ out:
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+/*
+ * A team is HPAGE_PMD_NR small page cache pages, caching a naturally
+ * aligned range of a file, which happen to be physically contiguous and
+ * naturally aligned too: shmem and readahead allocate them that way.
+ * Page cache is never compound, so every page of a team keeps its own
+ * reference count, mapcount and flags, and the rest of the VM keeps
+ * treating them as small pages.  While all of them stay in the page
+ * cache and uptodate the team can be mapped with a single huge pmd.
+ */
+
+/*
+ * Returns the first page of the team caching @index of @mapping, with a
+ * reference held on each page of the team, or NULL if there is no team.
+ */
+static struct page *find_get_team(struct address_space *mapping,
+				  pgoff_t index)
+{
+	struct page *head, *page;
+	int i;
+
+	head = find_get_page(mapping, index);
+	if (!head || radix_tree_exceptional_entry(head))
+		return NULL;
+	if (PageCompound(head) || (page_to_pfn(head) & (HPAGE_PMD_NR - 1))) {
+		page_cache_release(head);
+		return NULL;
+	}
+	for (i = 1; i < HPAGE_PMD_NR; i++) {
+		page = find_get_page(mapping, index + i);
+		if (page != head + i) {
+			if (page && !radix_tree_exceptional_entry(page))
+				page_cache_release(page);
+			while (i--)
+				page_cache_release(head + i);
+			return NULL;
+		}
+	}
+	return head;
+}
+
+static void put_team(struct page *head, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		page_cache_release(head + i);
+}
+
+static void unlock_team(struct page *head, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		unlock_page(head + i);
+}
+
+/*
+ * Returns true if a huge pmd at @haddr would map an aligned range of the
+ * file entirely inside @vma, and a fault with @flags may map it there.
+ */
+bool transhuge_file_vma_suitable(struct vm_area_struct *vma,
+				 unsigned long haddr, unsigned int flags)
+{
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		return false;
+	if (vma->vm_flags & (VM_NONLINEAR | VM_NOHUGEPAGE))
+		return false;
+	/* private copies are made a small page at a time */
+	if ((flags & FAULT_FLAG_WRITE) && !(vma->vm_flags & VM_SHARED))
+		return false;
+	return !(linear_page_index(vma, haddr) & (HPAGE_PMD_NR - 1));
+}
+
+/*
+ * Map the team caching the file range behind the huge pmd at @address,
+ * for a ->pmd_fault handler that made sure there is one.  Returns
+ * VM_FAULT_FALLBACK if the range can't be mapped huge right now.
+ */
+int do_huge_pmd_file_page(struct vm_area_struct *vma, unsigned long address,
+			  pmd_t *pmd, unsigned int flags)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	struct page *head, *page;
+	pgtable_t pgtable;
+	pgoff_t index, size;
+	pmd_t entry;
+	int i, locked = 0;
+
+	if (!transhuge_file_vma_suitable(vma, haddr, flags))
+		return VM_FAULT_FALLBACK;
+	index = linear_page_index(vma, haddr);
+	size = (i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1) >>
+		PAGE_CACHE_SHIFT;
+	if (index + HPAGE_PMD_NR > size)
+		return VM_FAULT_FALLBACK;
+
+	head = find_get_team(mapping, index);
+	if (!head)
+		return VM_FAULT_FALLBACK;
+
+	/* wait for reads in flight before taking any page lock */
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page = head + i;
+		if (!PageUptodate(page))
+			wait_on_page_locked(page);
+		if (!PageUptodate(page) || PageHWPoison(page))
+			goto fallback;
+	}
+
+	/*
+	 * Never sleep on a page lock while holding others: just give up,
+	 * the pte fault path copes with whatever is going on.
+	 */
+	for (; locked < HPAGE_PMD_NR; locked++) {
+		page = head + locked;
+		if (!trylock_page(page))
+			goto fallback;
+		if (page->mapping != mapping || !PageUptodate(page)) {
+			unlock_page(page);
+			goto fallback;
+		}
+	}
+	/* i_size might have shrunk while we were not holding the locks */
+	size = (i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1) >>
+		PAGE_CACHE_SHIFT;
+	if (index + HPAGE_PMD_NR > size)
+		goto fallback;
+
+	if (unlikely(!test_bit(MMF_VM_HUGEPAGE, &mm->flags)))
+		__khugepaged_enter(mm);
+
+	pgtable = pte_alloc_one(mm, haddr);
+	if (unlikely(!pgtable))
+		goto fallback;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_none(*pmd))) {
+		/* someone else mapped it, just retry the access */
+		spin_unlock(&mm->page_table_lock);
+		pte_free(mm, pgtable);
+		unlock_team(head, HPAGE_PMD_NR);
+		put_team(head, HPAGE_PMD_NR);
+		return 0;
+	}
+	entry = mk_pmd(head, vma->vm_page_prot);
+	if (flags & FAULT_FLAG_WRITE)
+		entry = maybe_pmd_mkwrite(pmd_mkdirty(entry), vma);
+	entry = pmd_mkhuge(entry);
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		page_add_file_rmap(head + i);
+	set_pmd_at(mm, haddr, pmd, entry);
+	prepare_pmd_huge_pte(pgtable, mm);
+	add_mm_counter(mm, MM_FILEPAGES, HPAGE_PMD_NR);
+	mm->nr_ptes++;
+	spin_unlock(&mm->page_table_lock);
+
+	/* the references now belong to the pmd */
+	unlock_team(head, HPAGE_PMD_NR);
+	count_vm_event(THP_FILE_MAPPED);
+	return 0;
+
+fallback:
+	unlock_team(head, locked);
+	put_team(head, HPAGE_PMD_NR);
+	return VM_FAULT_FALLBACK;
+}
+
 int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		  pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
 		  struct vm_area_struct *vma)
@@ -781,6 +953,12 @@ int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		goto out;
 	}
 	src_page = pmd_page(pmd);
+	if (!PageAnon(src_page)) {
+		/* the child faults page cache back in, as for small pages */
+		pte_free(dst_mm, pgtable);
+		ret = 0;
+		goto out_unlock;
+	}
 	VM_BUG_ON(!PageHead(src_page));
 	get_page(src_page);
 	page_dup_rmap(src_page);
@@ -996,6 +1174,7 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 				   unsigned int flags)
 {
 	struct page *page = NULL;
+	bool file;
 
 	assert_spin_locked(&mm->page_table_lock);
 
@@ -1003,22 +1182,30 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 		goto out;
 
 	page = pmd_page(*pmd);
-	VM_BUG_ON(!PageHead(page));
-	if (flags & FOLL_TOUCH) {
+	/* page cache mapped by a pmd is a team of small pages */
+	VM_BUG_ON(PageAnon(page) && !PageHead(page));
+	file = !PageAnon(page);
+	if (flags & FOLL_TOUCH && (!file || flags & FOLL_WRITE)) {
 		pmd_t _pmd;
 		/*
-		 * We should set the dirty bit only for FOLL_WRITE but
-		 * for now the dirty bit in the pmd is meaningless.
-		 * And if the dirty bit will become meaningful and
-		 * we'll only set it with FOLL_WRITE, an atomic
-		 * set_bit will be required on the pmd to set the
-		 * young bit, instead of the current set_pmd_at.
+		 * For anonymous memory the dirty bit in the pmd is
+		 * meaningless.  For page cache it is handed to all the
+		 * pages of the team on zap and split, so it is only set
+		 * for FOLL_WRITE; rewriting the pmd then cannot lose a
+		 * dirty bit the cpu set meanwhile.
 		 */
 		_pmd = pmd_mkyoung(pmd_mkdirty(*pmd));
 		set_pmd_at(mm, addr & HPAGE_PMD_MASK, pmd, _pmd);
 	}
 	page += (addr & ~HPAGE_PMD_MASK) >> PAGE_SHIFT;
-	VM_BUG_ON(!PageCompound(page));
+	VM_BUG_ON(PageCompound(page) != PageCompound(pmd_page(*pmd)));
+	/*
+	 * A read only touch of page cache must not rewrite the pmd, an
+	 * atomic set_bit would be needed for the young bit: mark the page
+	 * accessed instead, like follow_page() does for a pte.
+	 */
+	if (flags & FOLL_TOUCH && file && !(flags & FOLL_WRITE))
+		mark_page_accessed(page);
 	if (flags & FOLL_GET)
 		get_page_foll(page);
 
@@ -1034,17 +1221,35 @@ int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 	if (__pmd_trans_huge_lock(pmd, vma) == 1) {
 		struct page *page;
 		pgtable_t pgtable;
+		pmd_t orig_pmd;
+		int i, nr = 1;
 		pgtable = get_pmd_huge_pte(tlb->mm);
-		page = pmd_page(*pmd);
-		pmd_clear(pmd);
+		orig_pmd = pmdp_get_and_clear(tlb->mm, addr, pmd);
+		page = pmd_page(orig_pmd);
 		tlb_remove_pmd_tlb_entry(tlb, pmd, addr);
-		page_remove_rmap(page);
-		VM_BUG_ON(page_mapcount(page) < 0);
-		add_mm_counter(tlb->mm, MM_ANONPAGES, -HPAGE_PMD_NR);
-		VM_BUG_ON(!PageHead(page));
+		if (PageAnon(page)) {
+			page_remove_rmap(page);
+			VM_BUG_ON(page_mapcount(page) < 0);
+			add_mm_counter(tlb->mm, MM_ANONPAGES, -HPAGE_PMD_NR);
+			VM_BUG_ON(!PageHead(page));
+		} else {
+			/* a team of page cache pages, each mapped once */
+			nr = HPAGE_PMD_NR;
+			for (i = 0; i < nr; i++) {
+				if (pmd_dirty(orig_pmd))
+					set_page_dirty(page + i);
+				if (pmd_young(orig_pmd) &&
+				    likely(!VM_SequentialReadHint(vma)))
+					mark_page_accessed(page + i);
+				page_remove_rmap(page + i);
+				VM_BUG_ON(page_mapcount(page + i) < 0);
+			}
+			add_mm_counter(tlb->mm, MM_FILEPAGES, -HPAGE_PMD_NR);
+		}
 		tlb->mm->nr_ptes--;
 		spin_unlock(&tlb->mm->page_table_lock);
-		tlb_remove_page(tlb, page);
+		for (i = 0; i < nr; i++)
+			tlb_remove_page(tlb, page + i);
 		pte_free(tlb->mm, pgtable);
 		ret = 1;
 	}
@@ -1077,6 +1282,7 @@ int move_huge_pmd(struct vm_area_struct *vma, struct vm_area_struct *new_vma,
 {
 	int ret = 0;
 	pmd_t pmd;
+	struct address_space *mapping = NULL;
 
 	struct mm_struct *mm = vma->vm_mm;
 
@@ -1095,6 +1301,15 @@ int move_huge_pmd(struct vm_area_struct *vma, struct vm_area_struct *new_vma,
 		goto out;
 	}
 
+	/*
+	 * Page cache mapped by the pmd is found through the i_mmap tree
+	 * instead of the anon_vma: keep rmap walkers out until the pmd
+	 * is at its new address, as move_ptes() does.
+	 */
+	if (vma->vm_file) {
+		mapping = vma->vm_file->f_mapping;
+		mutex_lock(&mapping->i_mmap_mutex);
+	}
 	ret = __pmd_trans_huge_lock(old_pmd, vma);
 	if (ret == 1) {
 		pmd = pmdp_get_and_clear(mm, old_addr, old_pmd);
@@ -1102,6 +1317,8 @@ int move_huge_pmd(struct vm_area_struct *vma, struct vm_area_struct *new_vma,
 		set_pmd_at(mm, new_addr, new_pmd, pmd);
 		spin_unlock(&mm->page_table_lock);
 	}
+	if (mapping)
+		mutex_unlock(&mapping->i_mmap_mutex);
 out:
 	return ret;
 }
@@ -1193,6 +1410,39 @@ out:
 	return ret;
 }
 
+/*
+ * Page cache mapped by a huge pmd is a team of small pages, none of them
+ * compound: return the huge pmd mapping @page at @address, with the
+ * page_table_lock held, or NULL.
+ */
+pmd_t *page_check_address_team_pmd(struct page *page,
+				   struct mm_struct *mm,
+				   unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return NULL;
+
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return NULL;
+
+	pmd = pmd_offset(pud, address);
+	if (!pmd_trans_huge(*pmd))
+		return NULL;
+
+	spin_lock(&mm->page_table_lock);
+	if (pmd_trans_huge(*pmd) &&
+	    pmd_page(*pmd) + ((address & ~HPAGE_PMD_MASK) >> PAGE_SHIFT) == page)
+		return pmd;
+	spin_unlock(&mm->page_table_lock);
+	return NULL;
+}
+
 static int __split_huge_page_splitting(struct page *page,
 				       struct vm_area_struct *vma,
 				       unsigned long address)
@@ -1488,12 +1738,18 @@ out:
 int hugepage_madvise(struct vm_area_struct *vma,
 		     unsigned long *vm_flags, int advice)
 {
+	unsigned long no_thp = VM_NO_THP;
+
+	/* page cache a ->pmd_fault can map huge may well be shared */
+	if (vma->vm_ops && vma->vm_ops->pmd_fault)
+		no_thp &= ~(VM_SHARED | VM_MAYSHARE);
+
 	switch (advice) {
 	case MADV_HUGEPAGE:
 		/*
 		 * Be somewhat over-protective like KSM for now!
 		 */
-		if (*vm_flags & (VM_HUGEPAGE | VM_NO_THP))
+		if (*vm_flags & (VM_HUGEPAGE | no_thp))
 			return -EINVAL;
 		*vm_flags &= ~VM_NOHUGEPAGE;
 		*vm_flags |= VM_HUGEPAGE;
@@ -1509,7 +1765,7 @@ int hugepage_madvise(struct vm_area_struct *vma,
 		/*
 		 * Be somewhat over-protective like KSM for now!
 		 */
-		if (*vm_flags & (VM_NOHUGEPAGE | VM_NO_THP))
+		if (*vm_flags & (VM_NOHUGEPAGE | no_thp))
 			return -EINVAL;
 		*vm_flags &= ~VM_HUGEPAGE;
 		*vm_flags |= VM_NOHUGEPAGE;
@@ -2072,6 +2328,183 @@ out:
 	return ret;
 }
 
+/*
+ * File backed vmas are only scanned if their ->pmd_fault would map the
+ * page cache there huge: shmem mounted with huge=always, or read-only
+ * mappings of other files (see filemap_pmd_fault()).
+ */
+static bool khugepaged_file_vma(struct vm_area_struct *vma)
+{
+	if (!vma->vm_ops->pmd_fault || !vma->vm_file ||
+	    (vma->vm_flags & (VM_NONLINEAR | VM_NOHUGEPAGE)))
+		return false;
+	if (shmem_mapping(vma->vm_file->f_mapping))
+		return shmem_huge_enabled(vma);
+	return transparent_hugepage_enabled(vma) &&
+		!(vma->vm_flags & VM_WRITE);
+}
+
+/*
+ * The page cache behind @address is a team, but it is still mapped by a
+ * page table: free the page table so that the next fault maps the team
+ * with a huge pmd.  Only ptes mapping the team itself are dropped, they
+ * are refaulted cheaply; anything else (a private copy, a swap entry)
+ * makes us leave the page table alone.
+ */
+static void khugepaged_retract_pmd(struct mm_struct *mm,
+				   unsigned long address,
+				   struct address_space *mapping,
+				   pgoff_t index)
+{
+	struct vm_area_struct *vma;
+	struct page *head;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, _pmd;
+	pte_t *pte;
+	spinlock_t *ptl;
+	int i, mapped = 0;
+
+	down_write(&mm->mmap_sem);
+	if (unlikely(khugepaged_test_exit(mm)))
+		goto out;
+	vma = find_vma(mm, address);
+	if (!vma || vma->vm_start > address ||
+	    address + HPAGE_PMD_SIZE > vma->vm_end || !vma->vm_ops ||
+	    !vma->vm_file || vma->vm_file->f_mapping != mapping ||
+	    linear_page_index(vma, address) != index ||
+	    !khugepaged_file_vma(vma))
+		goto out;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		goto out;
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		goto out;
+	pmd = pmd_offset(pud, address);
+	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		goto out;
+
+	head = find_get_team(mapping, index);
+	if (!head)
+		goto out;
+
+	mutex_lock(&mapping->i_mmap_mutex);
+	mmu_notifier_invalidate_range_start(mm, address,
+					    address + HPAGE_PMD_SIZE);
+	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		pte_t pteval = pte[i];
+		if (pte_none(pteval))
+			continue;
+		if (!pte_present(pteval) ||
+		    pte_pfn(pteval) != page_to_pfn(head + i)) {
+			pte_unmap_unlock(pte, ptl);
+			goto out_notify;
+		}
+	}
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		unsigned long _address = address + i * PAGE_SIZE;
+		pte_t pteval;
+		if (pte_none(pte[i]))
+			continue;
+		pteval = ptep_get_and_clear(mm, _address, pte + i);
+		if (pte_dirty(pteval))
+			set_page_dirty(head + i);
+		page_remove_rmap(head + i);
+		/* we hold another reference until after the TLB flush */
+		page_cache_release(head + i);
+		mapped++;
+	}
+	pte_unmap_unlock(pte, ptl);
+	add_mm_counter(mm, MM_FILEPAGES, -mapped);
+
+	spin_lock(&mm->page_table_lock);
+	_pmd = pmdp_clear_flush(vma, address, pmd);
+	mm->nr_ptes--;
+	spin_unlock(&mm->page_table_lock);
+	pte_free(mm, pmd_pgtable(_pmd));
+out_notify:
+	mmu_notifier_invalidate_range_end(mm, address,
+					  address + HPAGE_PMD_SIZE);
+	mutex_unlock(&mapping->i_mmap_mutex);
+	put_team(head, HPAGE_PMD_NR);
+out:
+	up_write(&mm->mmap_sem);
+}
+
+/*
+ * Returns 1 with the mmap_sem released if the range at @address was worth
+ * collapsing, 0 with the mmap_sem still held otherwise.
+ */
+static int khugepaged_scan_file(struct mm_struct *mm,
+				struct vm_area_struct *vma,
+				unsigned long address)
+{
+	struct file *file = vma->vm_file;
+	struct address_space *mapping = file->f_mapping;
+	pgoff_t index = linear_page_index(vma, address);
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte, *_pte;
+	struct page *page;
+	unsigned long _address;
+	spinlock_t *ptl;
+	int ret = 0, referenced = 0;
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+
+	if (index & (HPAGE_PMD_NR - 1))
+		goto out;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		goto out;
+
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		goto out;
+
+	pmd = pmd_offset(pud, address);
+	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		goto out;
+
+	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
+	for (_address = address, _pte = pte; _pte < pte+HPAGE_PMD_NR;
+	     _pte++, _address += PAGE_SIZE) {
+		pte_t pteval = *_pte;
+		if (pte_none(pteval))
+			continue;
+		if (!pte_present(pteval))
+			goto out_unmap;
+		page = vm_normal_page(vma, _address, pteval);
+		if (unlikely(!page) || PageAnon(page) ||
+		    page->mapping != mapping ||
+		    page->index != index + (_pte - pte))
+			goto out_unmap;
+		if (pte_young(pteval) || PageReferenced(page) ||
+		    mmu_notifier_test_young(vma->vm_mm, _address))
+			referenced = 1;
+	}
+	if (referenced)
+		ret = 1;
+out_unmap:
+	pte_unmap_unlock(pte, ptl);
+	if (ret) {
+		get_file(file);
+		up_read(&mm->mmap_sem);
+		if (shmem_mapping(mapping))
+			shmem_collapse_team(mapping, index,
+					    khugepaged_max_ptes_none);
+		khugepaged_retract_pmd(mm, address, mapping, index);
+		fput(file);
+	}
+out:
+	return ret;
+}
+
 static void collect_mm_slot(struct mm_slot *mm_slot)
 {
 	struct mm_struct *mm = mm_slot->mm;
@@ -2135,14 +2568,15 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			break;
 		}
 
-		if ((!(vma->vm_flags & VM_HUGEPAGE) &&
-		     !khugepaged_always()) ||
-		    (vma->vm_flags & VM_NOHUGEPAGE)) {
+		if (!vma->vm_ops &&
+		    ((!(vma->vm_flags & VM_HUGEPAGE) &&
+		      !khugepaged_always()) ||
+		     (vma->vm_flags & VM_NOHUGEPAGE))) {
 		skip:
 			progress++;
 			continue;
 		}
-		if (!vma->anon_vma || vma->vm_ops)
+		if (vma->vm_ops ? !khugepaged_file_vma(vma) : !vma->anon_vma)
 			goto skip;
 		if (is_vma_temporary_stack(vma))
 			goto skip;
@@ -2150,8 +2584,8 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 		 * If is_pfn_mapping() is true is_learn_pfn_mapping()
 		 * must be true too, verify it here.
 		 */
-		VM_BUG_ON(is_linear_pfn_mapping(vma) ||
-			  vma->vm_flags & VM_NO_THP);
+		VM_BUG_ON(!vma->vm_ops && (is_linear_pfn_mapping(vma) ||
+					   vma->vm_flags & VM_NO_THP));
 
 		hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
 		hend = vma->vm_end & HPAGE_PMD_MASK;
@@ -2172,9 +2606,13 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			VM_BUG_ON(khugepaged_scan.address < hstart ||
 				  khugepaged_scan.address + HPAGE_PMD_SIZE >
 				  hend);
-			ret = khugepaged_scan_pmd(mm, vma,
-						  khugepaged_scan.address,
-						  hpage);
+			if (vma->vm_ops)
+				ret = khugepaged_scan_file(mm, vma,
+						khugepaged_scan.address);
+			else
+				ret = khugepaged_scan_pmd(mm, vma,
+						khugepaged_scan.address,
+						hpage);
 			/* move to next address */
 			khugepaged_scan.address += HPAGE_PMD_SIZE;
 			progress += HPAGE_PMD_NR;
@@ -2367,8 +2805,59 @@ static int khugepaged(void *none)
 	return 0;
 }
 
-void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
+/*
+ * Page cache is never compound: a pmd mapping a team of page cache pages
+ * is split by pointing a page table at the same small pages instead.
+ * Each of them is already mapped and referenced once on behalf of the
+ * pmd, and that carries over to its pte.
+ */
+static void __split_file_huge_pmd(struct vm_area_struct *vma,
+				  unsigned long haddr, pmd_t *pmd)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *page = pmd_page(*pmd);
+	pgtable_t pgtable;
+	pmd_t _pmd;
+	int i;
+
+	assert_spin_locked(&mm->page_table_lock);
+
+	pgtable = get_pmd_huge_pte(mm);
+	pmd_populate(mm, &_pmd, pgtable);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++, haddr += PAGE_SIZE) {
+		pte_t *pte, entry;
+		entry = mk_pte(page + i, vma->vm_page_prot);
+		/*
+		 * The hardware may set the dirty bit of a writable pmd
+		 * until the TLB flush below, so treat it as dirty.
+		 */
+		if (pmd_write(*pmd))
+			entry = pte_mkdirty(pte_mkwrite(entry));
+		else
+			entry = pte_wrprotect(entry);
+		if (pmd_dirty(*pmd))
+			entry = pte_mkdirty(entry);
+		if (!pmd_young(*pmd))
+			entry = pte_mkold(entry);
+		pte = pte_offset_map(&_pmd, haddr);
+		BUG_ON(!pte_none(*pte));
+		set_pte_at(mm, haddr, pte, entry);
+		pte_unmap(pte);
+	}
+	haddr -= HPAGE_PMD_SIZE;
+
+	smp_wmb(); /* make ptes visible before pmd */
+	/* see __split_huge_page_map() about the TLB flush ordering */
+	set_pmd_at(mm, haddr, pmd, pmd_mknotpresent(*pmd));
+	flush_tlb_range(vma, haddr, haddr + HPAGE_PMD_SIZE);
+	pmd_populate(mm, pmd, pgtable);
+}
+
+void __split_huge_page_pmd(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd)
 {
+	struct mm_struct *mm = vma->vm_mm;
 	struct page *page;
 
 	spin_lock(&mm->page_table_lock);
@@ -2377,6 +2866,11 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 		return;
 	}
 	page = pmd_page(*pmd);
+	if (!PageAnon(page)) {
+		__split_file_huge_pmd(vma, address & HPAGE_PMD_MASK, pmd);
+		spin_unlock(&mm->page_table_lock);
+		return;
+	}
 	VM_BUG_ON(!page_count(page));
 	get_page(page);
 	spin_unlock(&mm->page_table_lock);
@@ -2387,16 +2881,30 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 	BUG_ON(pmd_trans_huge(*pmd));
 }
 
-static void split_huge_page_address(struct mm_struct *mm,
-				    unsigned long address)
+/*
+ * For callers that walk page tables without the vma at hand.  A huge pmd
+ * only ever maps memory inside a vma, so there must be one.
+ */
+void split_huge_page_pmd_mm(struct mm_struct *mm, unsigned long address,
+			    pmd_t *pmd)
+{
+	struct vm_area_struct *vma;
+
+	if (likely(!pmd_trans_huge(*pmd)))
+		return;
+	vma = find_vma(mm, address);
+	BUG_ON(vma == NULL);
+	__split_huge_page_pmd(vma, address, pmd);
+}
+
+void split_huge_page_address(struct vm_area_struct *vma,
+			     unsigned long address)
 {
 	pgd_t *pgd;
 	pud_t *pud;
 	pmd_t *pmd;
 
-	VM_BUG_ON(!(address & ~HPAGE_PMD_MASK));
-
-	pgd = pgd_offset(mm, address);
+	pgd = pgd_offset(vma->vm_mm, address);
 	if (!pgd_present(*pgd))
 		return;
 
@@ -2408,10 +2916,12 @@ static void split_huge_page_address(struct mm_struct *mm,
 	if (!pmd_present(*pmd))
 		return;
 	/*
-	 * Caller holds the mmap_sem write mode, so a huge pmd cannot
+	 * Either the caller holds the mmap_sem write mode, or it holds
+	 * the page lock of a page cache page mapped at this address,
+	 * which do_huge_pmd_file_page() needs too: a huge pmd cannot
 	 * materialize from under us.
 	 */
-	split_huge_page_pmd(mm, pmd);
+	split_huge_page_pmd(vma, address, pmd);
 }
 
 void __vma_adjust_trans_huge(struct vm_area_struct *vma,
@@ -2427,7 +2937,7 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 	if (start & ~HPAGE_PMD_MASK &&
 	    (start & HPAGE_PMD_MASK) >= vma->vm_start &&
 	    (start & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= vma->vm_end)
-		split_huge_page_address(vma->vm_mm, start);
+		split_huge_page_address(vma, start);
 
 	/*
 	 * If the new end address isn't hpage aligned and it could
@@ -2437,7 +2947,7 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 	if (end & ~HPAGE_PMD_MASK &&
 	    (end & HPAGE_PMD_MASK) >= vma->vm_start &&
 	    (end & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= vma->vm_end)
-		split_huge_page_address(vma->vm_mm, end);
+		split_huge_page_address(vma, end);
 
 	/*
 	 * If we're also updating the vma->vm_next->vm_start, if the new
@@ -2451,6 +2961,6 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 		if (nstart & ~HPAGE_PMD_MASK &&
 		    (nstart & HPAGE_PMD_MASK) >= next->vm_start &&
 		    (nstart & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= next->vm_end)
-			split_huge_page_address(next->vm_mm, nstart);
+			split_huge_page_address(next, nstart);
 	}
 }
@@ -5270,8 +5270,9 @@ static enum mc_target_type get_mctgt_type_thp(struct vm_area_struct *vma,
 	enum mc_target_type ret = MC_TARGET_NONE;
 
 	page = pmd_page(pmd);
-	VM_BUG_ON(!page || !PageHead(page));
-	if (!move_anon())
+	VM_BUG_ON(!page || (PageAnon(page) && !PageHead(page)));
+	/* page cache mapped by a pmd is moved a small page at a time */
+	if (!PageAnon(page) || !move_anon())
 		return ret;
 	pc = lookup_page_cgroup(page);
 	if (PageCgroupUsed(pc) && pc->mem_cgroup == mc.from) {
@@ -57,6 +57,8 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/migrate.h>
+#include <linux/vmacache.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -1225,8 +1227,10 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		next = pmd_addr_end(addr, end);
 		if (pmd_trans_huge(*pmd)) {
 			if (next - addr != HPAGE_PMD_SIZE) {
-				VM_BUG_ON(!rwsem_is_locked(&tlb->mm->mmap_sem));
-				split_huge_page_pmd(vma->vm_mm, pmd);
+				/* truncation splits page cache pmds too */
+				VM_BUG_ON(!vma->vm_ops &&
+					  !rwsem_is_locked(&tlb->mm->mmap_sem));
+				split_huge_page_pmd(vma, addr, pmd);
 			} else if (zap_huge_pmd(tlb, vma, pmd, addr))
 				goto next;
 			/* fall through */
@@ -1495,7 +1499,7 @@ struct page *follow_page(struct vm_area_struct *vma, unsigned long address,
 	}
 	if (pmd_trans_huge(*pmd)) {
 		if (flags & FOLL_SPLIT) {
-			split_huge_page_pmd(mm, pmd);
+			split_huge_page_pmd(vma, address, pmd);
 			goto split_fallthrough;
 		}
 		spin_lock(&mm->page_table_lock);
@@ -3414,6 +3418,70 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
  * but allow concurrent faults), and pte mapped but not yet locked.
  * We return with mmap_sem still held, but pte unmapped and unlocked.
  */
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * A NUMA hinting fault: restore the protection change_prot_numa() took
+ * away, tell the scheduler which node the page is on and move it to the
+ * node of the faulting cpu if the memory policy wants it there.
+ */
+static int do_numa_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			unsigned long address, pte_t *page_table, pmd_t *pmd,
+			pte_t orig_pte)
+{
+	struct page *page;
+	spinlock_t *ptl;
+	pte_t entry;
+	int page_nid;
+	int target_nid;
+	int migrated = 0;
+
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock(ptl);
+	if (unlikely(!pte_same(*page_table, orig_pte))) {
+		pte_unmap_unlock(page_table, ptl);
+		return 0;
+	}
+
+	entry = pte_mkyoung(pte_modify(orig_pte, vma->vm_page_prot));
+	set_pte_at(mm, address, page_table, entry);
+	update_mmu_cache(vma, address, page_table);
+
+	page = vm_normal_page(vma, address, entry);
+	if (!page) {
+		pte_unmap_unlock(page_table, ptl);
+		return 0;
+	}
+
+	get_page(page);
+	page_nid = page_to_nid(page);
+	count_vm_numa_event(NUMA_HINT_FAULTS);
+	if (page_nid == numa_node_id())
+		count_vm_numa_event(NUMA_HINT_FAULTS_LOCAL);
+	target_nid = mpol_misplaced(page, vma, address);
+	pte_unmap_unlock(page_table, ptl);
+
+	if (target_nid == -1)
+		put_page(page);
+	else {
+		/* Drops our reference to the page */
+		migrated = migrate_misplaced_page(page, target_nid);
+		if (migrated)
+			page_nid = target_nid;
+	}
+
+	task_numa_fault(page_nid, 1, migrated);
+	return 0;
+}
+#else
+static inline int do_numa_page(struct mm_struct *mm,
+			struct vm_area_struct *vma, unsigned long address,
+			pte_t *page_table, pmd_t *pmd, pte_t orig_pte)
+{
+	BUG();
+	return 0;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 int handle_pte_fault(struct mm_struct *mm,
 		     struct vm_area_struct *vma, unsigned long address,
 		     pte_t *pte, pmd_t *pmd, unsigned int flags)
@@ -3439,6 +3507,9 @@ int handle_pte_fault(struct mm_struct *mm,
 					pte, pmd, flags, entry);
 	}
 
+	if (pte_numa(vma, entry))
+		return do_numa_page(mm, vma, address, pte, pmd, entry);
+
 	ptl = pte_lockptr(mm, pmd);
 	spin_lock(ptl);
 	if (unlikely(!pte_same(*pte, entry)))
@@ -3496,20 +3567,34 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pmd = pmd_alloc(mm, pud, address);
 	if (!pmd)
 		return VM_FAULT_OOM;
-	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma)) {
-		if (!vma->vm_ops)
-			return do_huge_pmd_anonymous_page(mm, vma, address,
-							  pmd, flags);
+	if (pmd_none(*pmd)) {
+		if (!vma->vm_ops) {
+			if (transparent_hugepage_enabled(vma))
+				return do_huge_pmd_anonymous_page(mm, vma,
+						address, pmd, flags);
+		} else if (vma->vm_ops->pmd_fault) {
+			int ret = vma->vm_ops->pmd_fault(vma, address, pmd,
+							 flags);
+			if (!(ret & VM_FAULT_FALLBACK))
+				return ret;
+		}
 	} else {
 		pmd_t orig_pmd = *pmd;
 		barrier();
 		if (pmd_trans_huge(orig_pmd)) {
-			if (flags & FAULT_FLAG_WRITE &&
-			    !pmd_write(orig_pmd) &&
-			    !pmd_trans_splitting(orig_pmd))
+			if (!(flags & FAULT_FLAG_WRITE) ||
+			    pmd_write(orig_pmd) ||
+			    pmd_trans_splitting(orig_pmd))
+				return 0;
+			if (!vma->vm_ops)
 				return do_huge_pmd_wp_page(mm, vma, address,
 							   pmd, orig_pmd);
-			return 0;
+			/*
+			 * Page cache mapped by a pmd is written through
+			 * ptes, so that write faults and dirty tracking
+			 * work a small page at a time.
+			 */
+			split_huge_page_pmd(vma, address, pmd);
 		}
 	}
 
@@ -3534,6 +3619,160 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Handle a first-touch fault on private anonymous memory without taking
+ * mmap_sem.  The vma is looked up in the current thread's vma cache under
+ * rcu_read_lock(), and its vm_sequence is sampled; the pte is then
+ * installed only if, with the page table lock held, neither the mm's vma
+ * cache sequence nor the vma's sequence has moved.  Interrupts are kept
+ * off around the page table walk, which, as for get_user_pages_fast(),
+ * holds off the TLB shootdown that must precede freeing the page tables.
+ *
+ * Returns VM_FAULT_RETRY whenever the fault has to be retried the usual
+ * way, under mmap_sem.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_area_struct *vma;
+	struct page *page = NULL;
+	unsigned long vm_flags;
+	pgprot_t vm_page_prot;
+	unsigned int seq;
+	u32 cache_seq;
+	spinlock_t *ptl;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, pmdval;
+	pte_t *pte, entry;
+
+	rcu_read_lock();
+	vma = vmacache_find_rcu(mm, address, &cache_seq);
+	if (!vma)
+		goto out_rcu;
+
+	/*
+	 * Not read_seqcount_begin(): a vma that has been removed from its
+	 * mm stays odd for good, and we must not spin on it.
+	 */
+	seq = ACCESS_ONCE(vma->vm_sequence.sequence);
+	smp_rmb();
+	if (seq & 1)
+		goto out_rcu;
+
+	/*
+	 * The cache lookup matched the address before the sequence was
+	 * sampled: a split (mprotect, mlock, munmap of part of the vma)
+	 * shrinks the vma without unlinking it, so check again.
+	 */
+	if (address < vma->vm_start || address >= vma->vm_end)
+		goto out_rcu;
+	vm_flags = vma->vm_flags;
+	vm_page_prot = vma->vm_page_prot;
+	if (vma->vm_ops || vma_policy(vma) ||
+	    (vm_flags & (VM_SHARED | VM_LOCKED | VM_GROWSDOWN | VM_GROWSUP |
+			 VM_HUGETLB | VM_PFNMAP | VM_MIXEDMAP | VM_IO)))
+		goto out_rcu;
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(vm_flags & VM_WRITE) || !vma->anon_vma)
+			goto out_rcu;
+	} else if (!(vm_flags & (VM_READ | VM_EXEC | VM_WRITE)))
+		goto out_rcu;
+	if (read_seqcount_retry(&vma->vm_sequence, seq))
+		goto out_rcu;
+	rcu_read_unlock();
+
+	if (flags & FAULT_FLAG_WRITE) {
+		page = alloc_page(GFP_HIGHUSER_MOVABLE);
+		if (!page)
+			return VM_FAULT_RETRY;
+		clear_user_highpage(page, address);
+		__SetPageUptodate(page);
+		if (mem_cgroup_newpage_charge(page, mm, GFP_KERNEL)) {
+			page_cache_release(page);
+			return VM_FAULT_RETRY;
+		}
+		entry = mk_pte(page, vm_page_prot);
+		if (vm_flags & VM_WRITE)
+			entry = pte_mkwrite(pte_mkdirty(entry));
+	} else
+		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
+					      vm_page_prot));
+
+	rcu_read_lock();
+	local_irq_disable();
+	if (ACCESS_ONCE(mm->vmacache_seqnum) != cache_seq ||
+	    read_seqcount_retry(&vma->vm_sequence, seq))
+		goto out_irq;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		goto out_irq;
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		goto out_irq;
+	pmd = pmd_offset(pud, address);
+	/* a single load without mmap_sem, hence X86_64 only: no PAE tearing */
+	pmdval = ACCESS_ONCE(*pmd);
+	if (pmd_none(pmdval) || pmd_trans_huge(pmdval) || pmd_bad(pmdval))
+		goto out_irq;
+
+	pte = pte_offset_map(&pmdval, address);
+	ptl = pte_lockptr(mm, &pmdval);
+	if (!spin_trylock(ptl)) {
+		pte_unmap(pte);
+		goto out_irq;
+	}
+	if (read_seqcount_retry(&vma->vm_sequence, seq) ||
+	    !pmd_same(*pmd, pmdval)) {
+		pte_unmap_unlock(pte, ptl);
+		goto out_irq;
+	}
+	if (!pte_none(*pte)) {
+		/* Somebody else got there first */
+		pte_unmap_unlock(pte, ptl);
+		local_irq_enable();
+		rcu_read_unlock();
+		if (page) {
+			mem_cgroup_uncharge_page(page);
+			page_cache_release(page);
+		}
+		return 0;
+	}
+
+	if (page) {
+		inc_mm_counter_fast(mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, vma, address);
+	}
+	set_pte_at(mm, address, pte, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(vma, address, pte);
+	pte_unmap_unlock(pte, ptl);
+	local_irq_enable();
+	rcu_read_unlock();
+
+	count_vm_event(PGFAULT);
+	count_vm_event(SPECULATIVE_PGFAULT);
+	mem_cgroup_count_vm_event(mm, PGFAULT);
+	return 0;
+
+out_irq:
+	local_irq_enable();
+	rcu_read_unlock();
+	if (page) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+	}
+	return VM_FAULT_RETRY;
+
+out_rcu:
+	rcu_read_unlock();
+	return VM_FAULT_RETRY;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
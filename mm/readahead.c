@@ -202,6 +202,47 @@ out:
 	return ret;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Read a huge page worth of the file at @index, which must be aligned,
+ * into physically contiguous and aligned small pages, so that a pmd can
+ * map all of them at once (see do_huge_pmd_file_page()).  The caller made
+ * sure nothing is cached there yet.  Returns the number of pages read, or
+ * 0 if no huge page could be allocated cheaply.
+ */
+int page_cache_read_team(struct address_space *mapping, struct file *filp,
+			 pgoff_t index)
+{
+	struct inode *inode = mapping->host;
+	struct page *page;
+	LIST_HEAD(page_pool);
+	loff_t isize = i_size_read(inode);
+	int i;
+
+	if (unlikely(!mapping->a_ops->readpage && !mapping->a_ops->readpages))
+		return 0;
+	if (isize == 0 ||
+	    index + HPAGE_PMD_NR - 1 > ((isize - 1) >> PAGE_CACHE_SHIFT))
+		return 0;
+
+	page = alloc_pages(mapping_gfp_mask(mapping) | __GFP_COLD |
+			   __GFP_NORETRY | __GFP_NOWARN, HPAGE_PMD_ORDER);
+	if (!page)
+		return 0;
+	count_vm_event(THP_FILE_ALLOC);
+
+	/* page cache is never compound: the team is HPAGE_PMD_NR pages */
+	split_page(page, HPAGE_PMD_ORDER);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page[i].index = index + i;
+		list_add(&page[i].lru, &page_pool);
+	}
+	read_pages(mapping, filp, &page_pool, HPAGE_PMD_NR);
+	BUG_ON(!list_empty(&page_pool));
+	return HPAGE_PMD_NR;
+}
+#endif
+
 /*
  * Chunk the readahead into 2 megabyte units, so that we don't pin too much
  * memory at once.
@@ -695,10 +695,9 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 {
 	struct mm_struct *mm = vma->vm_mm;
 	int referenced = 0;
+	pmd_t *pmd;
 
 	if (unlikely(PageTransHuge(page))) {
-		pmd_t *pmd;
-
 		spin_lock(&mm->page_table_lock);
 		/*
 		 * rmap might return false positives; we must filter
@@ -722,6 +721,33 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 		if (pmdp_clear_flush_young_notify(vma, address, pmd))
 			referenced++;
 		spin_unlock(&mm->page_table_lock);
+	} else if (!PageAnon(page) &&
+		   (pmd = page_check_address_team_pmd(page, mm, address))) {
+		struct page *team = pmd_page(*pmd);
+		int i;
+
+		if (vma->vm_flags & VM_LOCKED) {
+			spin_unlock(&mm->page_table_lock);
+			*mapcount = 0;	/* break early from loop */
+			*vm_flags |= VM_LOCKED;
+			goto out;
+		}
+
+		/*
+		 * One young bit covers the whole team: hand it to the
+		 * other pages as PG_referenced when it is harvested, so
+		 * that they still count as referenced when their turn
+		 * comes.
+		 */
+		if (pmdp_clear_flush_young_notify(vma, address & HPAGE_PMD_MASK,
+						  pmd)) {
+			for (i = 0; i < HPAGE_PMD_NR; i++)
+				if (team + i != page)
+					SetPageReferenced(team + i);
+			referenced++;
+		} else if (TestClearPageReferenced(page))
+			referenced++;
+		spin_unlock(&mm->page_table_lock);
 	} else {
 		pte_t *pte;
 		spinlock_t *ptl;
@@ -1237,6 +1263,10 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	spinlock_t *ptl;
 	int ret = SWAP_AGAIN;
 
+	/* page cache mapped by a huge pmd is unmapped a pte at a time */
+	if (!PageAnon(page))
+		split_huge_page_address(vma, address);
+
 	pte = page_check_address(page, mm, address, &ptl, 0);
 	if (!pte)
 		goto out;
@@ -60,6 +60,7 @@ static struct vfsmount *shm_mnt;
 #include <linux/namei.h>
 #include <linux/ctype.h>
 #include <linux/migrate.h>
+#include <linux/rmap.h>
 #include <linux/highmem.h>
 #include <linux/seq_file.h>
 #include <linux/magic.h>
@@ -223,6 +224,11 @@ static void shmem_recalc_inode(struct inode *inode)
 	}
 }
 
+bool shmem_mapping(struct address_space *mapping)
+{
+	return mapping->backing_dev_info == &shmem_backing_dev_info;
+}
+
 /*
  * Replace item expected in radix tree by a new item, while holding tree lock.
  */
@@ -828,6 +834,23 @@ static struct page *shmem_alloc_page(gfp_t gfp,
 	 */
 	return alloc_page_vma(gfp, &pvma, 0);
 }
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t index)
+{
+	struct vm_area_struct pvma;
+
+	/* Create a pseudo vma that just contains the policy */
+	pvma.vm_start = 0;
+	pvma.vm_pgoff = index;
+	pvma.vm_ops = NULL;
+	pvma.vm_policy = mpol_shared_policy_lookup(&info->policy, index);
+
+	return alloc_pages_vma(gfp, HPAGE_PMD_ORDER, &pvma, 0,
+			       numa_node_id());
+}
+#endif
 #else /* !CONFIG_NUMA */
 #ifdef CONFIG_TMPFS
 static inline void shmem_show_mpol(struct seq_file *seq, struct mempolicy *mpol)
@@ -846,6 +869,14 @@ static inline struct page *shmem_alloc_page(gfp_t gfp,
 {
 	return alloc_page(gfp);
 }
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static inline struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t index)
+{
+	return alloc_pages(gfp, HPAGE_PMD_ORDER);
+}
+#endif
 #endif /* CONFIG_NUMA */
 
 #if !defined(CONFIG_NUMA) || !defined(CONFIG_TMPFS)
@@ -1065,6 +1096,289 @@ static int shmem_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	return ret;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * With huge=always, tmpfs allocates a file a huge page at a time where it
+ * can, as a team of small pages (see do_huge_pmd_file_page()): they stay
+ * small pages to the page cache, to swap and to reclaim, but a pmd can
+ * map all of them at once while they are together.
+ */
+
+/*
+ * Like shmem_acct_block() and the max_blocks check of shmem_getpage_gfp(),
+ * for @pages blocks at once.
+ */
+static int shmem_reserve_blocks(struct inode *inode, long pages)
+{
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+
+	if ((info->flags & VM_NORESERVE) &&
+	    security_vm_enough_memory_mm(current->mm,
+					 pages * VM_ACCT(PAGE_CACHE_SIZE)))
+		return -ENOSPC;
+	if (sbinfo->max_blocks) {
+		if (percpu_counter_compare(&sbinfo->used_blocks,
+				(s64)sbinfo->max_blocks - pages) > 0) {
+			shmem_unacct_blocks(info->flags, pages);
+			return -ENOSPC;
+		}
+		percpu_counter_add(&sbinfo->used_blocks, pages);
+	}
+	return 0;
+}
+
+static void shmem_unreserve_blocks(struct inode *inode, long pages)
+{
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+
+	if (sbinfo->max_blocks)
+		percpu_counter_add(&sbinfo->used_blocks, -pages);
+	shmem_unacct_blocks(SHMEM_I(inode)->flags, pages);
+}
+
+static void shmem_alloced_blocks(struct inode *inode, long pages)
+{
+	struct shmem_inode_info *info = SHMEM_I(inode);
+
+	spin_lock(&info->lock);
+	info->alloced += pages;
+	inode->i_blocks += pages * BLOCKS_PER_PAGE;
+	shmem_recalc_inode(inode);
+	spin_unlock(&info->lock);
+}
+
+/*
+ * Get rid of what we added to the page cache beyond a truncation that
+ * raced with us, as shmem_getpage_gfp() does for a single page.
+ */
+static void shmem_truncate_team_tail(struct inode *inode, pgoff_t index)
+{
+	loff_t start = (loff_t)index << PAGE_CACHE_SHIFT;
+	loff_t end = (loff_t)(index + HPAGE_PMD_NR) << PAGE_CACHE_SHIFT;
+	loff_t isize = round_up(i_size_read(inode), PAGE_CACHE_SIZE);
+
+	if (isize < end)
+		shmem_truncate_range(inode, max(isize, start), end - 1);
+}
+
+static inline gfp_t shmem_huge_gfp(struct address_space *mapping, bool defrag)
+{
+	gfp_t gfp = mapping_gfp_mask(mapping) | __GFP_NOMEMALLOC |
+		    __GFP_NORETRY | __GFP_NOWARN | __GFP_NO_KSWAPD;
+
+	return defrag ? gfp : gfp & ~__GFP_WAIT;
+}
+
+/*
+ * Fill an empty, aligned range of @inode with a team of zeroed pages.
+ * Pages somebody else instantiated meanwhile are left alone, so the team
+ * may come out incomplete: that costs nothing but the chance to map it
+ * with a pmd.
+ */
+static int shmem_alloc_team(struct inode *inode, pgoff_t index, gfp_t gfp)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct page *head, *page;
+	int i, error, nr = 0;
+
+	error = shmem_reserve_blocks(inode, HPAGE_PMD_NR);
+	if (error)
+		return error;
+
+	head = shmem_alloc_hugepage(gfp, SHMEM_I(inode), index);
+	if (!head) {
+		shmem_unreserve_blocks(inode, HPAGE_PMD_NR);
+		return -ENOMEM;
+	}
+	count_vm_event(THP_FILE_ALLOC);
+	split_page(head, HPAGE_PMD_ORDER);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page = head + i;
+		clear_highpage(page);
+		flush_dcache_page(page);
+		SetPageUptodate(page);
+		SetPageSwapBacked(page);
+		__set_page_locked(page);
+		error = mem_cgroup_cache_charge(page, current->mm,
+						gfp & GFP_RECLAIM_MASK);
+		if (!error)
+			error = shmem_add_to_page_cache(page, mapping,
+							index + i, gfp, NULL);
+		if (!error) {
+			lru_cache_add_anon(page);
+			nr++;
+		}
+		unlock_page(page);
+		page_cache_release(page);
+	}
+
+	shmem_alloced_blocks(inode, nr);
+	if (nr < HPAGE_PMD_NR)
+		shmem_unreserve_blocks(inode, HPAGE_PMD_NR - nr);
+	shmem_truncate_team_tail(inode, index);
+	return nr ? 0 : error;
+}
+
+/*
+ * Replace @old, locked, by a locked copy @page in the page cache: for
+ * shmem_collapse_team(), so gives up on anything it can't easily move.
+ */
+static int shmem_replace_by_copy(struct page *old, struct page *page,
+				 gfp_t gfp)
+{
+	int error;
+
+	if (PageWriteback(old) || !PageUptodate(old) || PageCompound(old))
+		return -EBUSY;
+	if (page_mapped(old) &&
+	    try_to_unmap(old, TTU_UNMAP | TTU_IGNORE_MLOCK |
+			      TTU_IGNORE_ACCESS) != SWAP_SUCCESS)
+		return -EBUSY;
+	/* the page cache and us: nobody else may be looking at it */
+	if (page_count(old) != 2 || page_has_private(old))
+		return -EBUSY;
+
+	copy_highpage(page, old);
+	flush_dcache_page(page);
+	SetPageUptodate(page);
+	error = replace_page_cache_page(old, page, gfp);
+	if (error)
+		return error;
+	if (PageDirty(old))
+		set_page_dirty(page);
+	lru_cache_add_anon(page);
+	return 0;
+}
+
+/**
+ * shmem_collapse_team - copy a range of a file into a team of pages
+ * @mapping: the shmem mapping
+ * @index: first page index of the range, aligned to HPAGE_PMD_NR
+ * @max_holes: how many pages may have to be allocated afresh
+ *
+ * For khugepaged: copies the pages of the range into a new team, filling
+ * holes with zeroes, so that the range can be mapped with a pmd.  Gives
+ * up on swapped out pages and pages somebody else is using, leaving the
+ * range partly collapsed, which is harmless.
+ */
+int shmem_collapse_team(struct address_space *mapping, pgoff_t index,
+			int max_holes)
+{
+	struct inode *inode = mapping->host;
+	struct page *head, *page, *old;
+	pgoff_t size;
+	gfp_t gfp;
+	int i, error = 0, holes = 0, nr = 0;
+
+	if (!shmem_mapping(mapping) || !SHMEM_SB(inode->i_sb)->huge)
+		return -EINVAL;
+	size = DIV_ROUND_UP(i_size_read(inode), PAGE_CACHE_SIZE);
+	if (index + HPAGE_PMD_NR > size)
+		return -EINVAL;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		old = find_get_page(mapping, index + i);
+		if (!old) {
+			if (++holes > max_holes)
+				return -EBUSY;
+			continue;
+		}
+		if (radix_tree_exceptional_entry(old))
+			return -EBUSY;
+		page_cache_release(old);
+	}
+
+	gfp = shmem_huge_gfp(mapping, true);
+	head = shmem_alloc_hugepage(gfp, SHMEM_I(inode), index);
+	if (!head)
+		return -ENOMEM;
+	count_vm_event(THP_FILE_ALLOC);
+	split_page(head, HPAGE_PMD_ORDER);
+	/* pages still in a pagevec are held by it */
+	lru_add_drain();
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page = head + i;
+		if (error) {
+			page_cache_release(page);
+			continue;
+		}
+		SetPageSwapBacked(page);
+		__set_page_locked(page);
+
+		old = find_lock_page(mapping, index + i);
+		if (radix_tree_exceptional_entry(old)) {
+			error = -EBUSY;
+		} else if (old) {
+			error = shmem_replace_by_copy(old, page, gfp);
+			unlock_page(old);
+			page_cache_release(old);
+		} else {
+			error = shmem_reserve_blocks(inode, 1);
+			if (error)
+				goto next;
+			clear_highpage(page);
+			flush_dcache_page(page);
+			SetPageUptodate(page);
+			error = mem_cgroup_cache_charge(page, current->mm,
+							gfp & GFP_RECLAIM_MASK);
+			if (!error)
+				error = shmem_add_to_page_cache(page, mapping,
+							index + i, gfp, NULL);
+			if (error) {
+				shmem_unreserve_blocks(inode, 1);
+				goto next;
+			}
+			lru_cache_add_anon(page);
+			nr++;
+		}
+next:
+		unlock_page(page);
+		page_cache_release(page);
+	}
+
+	shmem_alloced_blocks(inode, nr);
+	if (nr)
+		shmem_truncate_team_tail(inode, index);
+	return error;
+}
+
+bool shmem_huge_enabled(struct vm_area_struct *vma)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+
+	return SHMEM_SB(inode->i_sb)->huge &&
+		!(vma->vm_flags & VM_NOHUGEPAGE);
+}
+
+static int shmem_pmd_fault(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd, unsigned int flags)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pgoff_t index, size;
+
+	if (!shmem_huge_enabled(vma) ||
+	    !transhuge_file_vma_suitable(vma, haddr, flags))
+		return VM_FAULT_FALLBACK;
+
+	index = linear_page_index(vma, haddr);
+	size = DIV_ROUND_UP(i_size_read(inode), PAGE_CACHE_SIZE);
+	if (index + HPAGE_PMD_NR > size)
+		return VM_FAULT_FALLBACK;
+
+	if (page_cache_range_empty(inode->i_mapping, index, HPAGE_PMD_NR) &&
+	    shmem_alloc_team(inode, index,
+			     shmem_huge_gfp(inode->i_mapping,
+					    transparent_hugepage_defrag(vma))))
+		return VM_FAULT_FALLBACK;
+
+	return do_huge_pmd_file_page(vma, address, pmd, flags);
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 #ifdef CONFIG_NUMA
 static int shmem_set_policy(struct vm_area_struct *vma, struct mempolicy *mpol)
 {
@@ -2146,6 +2460,15 @@ static int shmem_parse_options(char *options, struct shmem_sb_info *sbinfo,
 		} else if (!strcmp(this_char,"mpol")) {
 			if (mpol_parse_str(value, &sbinfo->mpol, 1))
 				goto bad_val;
+		} else if (!strcmp(this_char,"huge")) {
+			if (!strcmp(value, "never"))
+				sbinfo->huge = false;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+			else if (!strcmp(value, "always"))
+				sbinfo->huge = true;
+#endif
+			else
+				goto bad_val;
 		} else {
 			printk(KERN_ERR "tmpfs: Bad mount option %s\n",
 			       this_char);
@@ -2194,6 +2517,7 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 
 	mpol_put(sbinfo->mpol);
 	sbinfo->mpol        = config.mpol;	/* transfers initial ref */
+	sbinfo->huge        = config.huge;
 out:
 	spin_unlock(&sbinfo->stat_lock);
 	return error;
@@ -2215,6 +2539,8 @@ static int shmem_show_options(struct seq_file *seq, struct dentry *root)
 	if (sbinfo->gid != 0)
 		seq_printf(seq, ",gid=%u", sbinfo->gid);
 	shmem_show_mpol(seq, sbinfo->mpol);
+	if (sbinfo->huge)
+		seq_printf(seq, ",huge=always");
 	return 0;
 }
 #endif /* CONFIG_TMPFS */
@@ -2426,6 +2752,9 @@ static const struct super_operations shmem_ops = {
 
 static const struct vm_operations_struct shmem_vm_ops = {
 	.fault		= shmem_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.pmd_fault	= shmem_pmd_fault,
+#endif
 #ifdef CONFIG_NUMA
 	.set_policy     = shmem_set_policy,
 	.get_policy     = shmem_get_policy,
@@ -2526,6 +2855,24 @@ void shmem_unlock_mapping(struct address_space *mapping)
 {
 }
 
+bool shmem_mapping(struct address_space *mapping)
+{
+	return false;
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+bool shmem_huge_enabled(struct vm_area_struct *vma)
+{
+	return false;
+}
+
+int shmem_collapse_team(struct address_space *mapping, pgoff_t index,
+			int max_holes)
+{
+	return -EINVAL;
+}
+#endif
+
 void shmem_truncate_range(struct inode *inode, loff_t lstart, loff_t lend)
 {
 	truncate_inode_pages_range(inode->i_mapping, lstart, lend);
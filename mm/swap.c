@@ -30,13 +30,34 @@
 #include <linux/backing-dev.h>
 #include <linux/memcontrol.h>
 #include <linux/gfp.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
 
 #include "internal.h"
 
 /* How many pages do we try to swap or page in/out together? */
 int page_cluster;
 
-static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
+/*
+ * Pages on their way to the LRU gather in per-cpu caches, one per list.
+ * A cache is drained into the LRU once it holds ->batch pages: that starts
+ * at PAGEVEC_SIZE, is doubled (up to LRU_ADD_BATCH_MAX) whenever a drain
+ * had to wait for a zone's lru_lock, and creeps back down by one after
+ * each drain that did not.  CPUs that fight over an lru_lock thus take it
+ * less often, while on a quiet system few pages are kept off the LRU,
+ * where reclaim, isolation and munlock cannot see them.
+ */
+#define LRU_ADD_BATCH_MAX	(4 * PAGEVEC_SIZE)
+
+struct lru_add_cache {
+	unsigned int nr;
+	unsigned int batch;
+	struct page *pages[LRU_ADD_BATCH_MAX];
+};
+
+static DEFINE_PER_CPU(struct lru_add_cache[NR_LRU_LISTS], lru_add_caches) = {
+	[0 ... NR_LRU_LISTS - 1] = { .batch = PAGEVEC_SIZE },
+};
 static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_deactivate_pvecs);
 
@@ -201,30 +222,49 @@ void put_pages_list(struct list_head *pages)
 }
 EXPORT_SYMBOL(put_pages_list);
 
-static void pagevec_lru_move_fn(struct pagevec *pvec,
-				void (*move_fn)(struct page *page, void *arg),
-				void *arg)
+/*
+ * Apply move_fn to each of the pages under its zone's lru_lock, which is
+ * retained across runs of pages from the same zone, then drop the
+ * references held on the pages.  Returns true if any lru_lock was found
+ * contended.
+ */
+static bool lru_move_pages(struct page **pages, int nr, int cold,
+			   void (*move_fn)(struct page *page, void *arg),
+			   void *arg)
 {
 	int i;
 	struct zone *zone = NULL;
 	unsigned long flags = 0;
+	bool contended = false;
 
-	for (i = 0; i < pagevec_count(pvec); i++) {
-		struct page *page = pvec->pages[i];
+	for (i = 0; i < nr; i++) {
+		struct page *page = pages[i];
 		struct zone *pagezone = page_zone(page);
 
 		if (pagezone != zone) {
 			if (zone)
 				spin_unlock_irqrestore(&zone->lru_lock, flags);
 			zone = pagezone;
-			spin_lock_irqsave(&zone->lru_lock, flags);
+			if (!spin_trylock_irqsave(&zone->lru_lock, flags)) {
+				contended = true;
+				spin_lock_irqsave(&zone->lru_lock, flags);
+			}
 		}
 
 		(*move_fn)(page, arg);
 	}
 	if (zone)
 		spin_unlock_irqrestore(&zone->lru_lock, flags);
-	release_pages(pvec->pages, pvec->nr, pvec->cold);
+	release_pages(pages, nr, cold);
+	return contended;
+}
+
+static void pagevec_lru_move_fn(struct pagevec *pvec,
+				void (*move_fn)(struct page *page, void *arg),
+				void *arg)
+{
+	lru_move_pages(pvec->pages, pagevec_count(pvec), pvec->cold,
+		       move_fn, arg);
 	pagevec_reinit(pvec);
 }
 
@@ -325,6 +365,11 @@ static void activate_page_drain(int cpu)
 		pagevec_lru_move_fn(pvec, __activate_page, NULL);
 }
 
+static bool need_activate_page_drain(int cpu)
+{
+	return pagevec_count(&per_cpu(activate_page_pvecs, cpu)) != 0;
+}
+
 void activate_page(struct page *page)
 {
 	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
@@ -342,6 +387,11 @@ static inline void activate_page_drain(int cpu)
 {
 }
 
+static inline bool need_activate_page_drain(int cpu)
+{
+	return false;
+}
+
 void activate_page(struct page *page)
 {
 	struct zone *zone = page_zone(page);
@@ -371,14 +421,32 @@ void mark_page_accessed(struct page *page)
 }
 EXPORT_SYMBOL(mark_page_accessed);
 
+static void __pagevec_lru_add_fn(struct page *page, void *arg);
+
+/*
+ * Move the pages gathered in an lru_add cache onto the LRU, and adapt the
+ * cache's batch size to how contended the lru_locks were.
+ */
+static void lru_add_cache_drain(struct lru_add_cache *cache, enum lru_list lru)
+{
+	if (lru_move_pages(cache->pages, cache->nr, 0,
+			   __pagevec_lru_add_fn, (void *)lru))
+		cache->batch = min_t(unsigned int, 2 * cache->batch,
+				     LRU_ADD_BATCH_MAX);
+	else if (cache->batch > PAGEVEC_SIZE)
+		cache->batch--;
+	cache->nr = 0;
+}
+
 void __lru_cache_add(struct page *page, enum lru_list lru)
 {
-	struct pagevec *pvec = &get_cpu_var(lru_add_pvecs)[lru];
+	struct lru_add_cache *cache = &get_cpu_var(lru_add_caches)[lru];
 
 	page_cache_get(page);
-	if (!pagevec_add(pvec, page))
-		__pagevec_lru_add(pvec, lru);
-	put_cpu_var(lru_add_pvecs);
+	cache->pages[cache->nr++] = page;
+	if (cache->nr >= cache->batch)
+		lru_add_cache_drain(cache, lru);
+	put_cpu_var(lru_add_caches);
 }
 EXPORT_SYMBOL(__lru_cache_add);
 
@@ -498,14 +566,15 @@ static void lru_deactivate_fn(struct page *page, void *arg)
  */
 void lru_add_drain_cpu(int cpu)
 {
-	struct pagevec *pvecs = per_cpu(lru_add_pvecs, cpu);
+	struct lru_add_cache *caches = per_cpu(lru_add_caches, cpu);
 	struct pagevec *pvec;
 	int lru;
 
 	for_each_lru(lru) {
-		pvec = &pvecs[lru - LRU_BASE];
-		if (pagevec_count(pvec))
-			__pagevec_lru_add(pvec, lru);
+		struct lru_add_cache *cache = &caches[lru - LRU_BASE];
+
+		if (cache->nr)
+			lru_add_cache_drain(cache, lru);
 	}
 
 	pvec = &per_cpu(lru_rotate_pvecs, cpu);
@@ -562,12 +631,60 @@ static void lru_add_drain_per_cpu(struct work_struct *dummy)
 	lru_add_drain();
 }
 
+static DEFINE_PER_CPU(struct work_struct, lru_add_drain_work);
+
+/*
+ * Whether any of the cpu's caches hold pages.  Read without any locking
+ * from another cpu: pages that the caller of lru_add_drain_all() queued
+ * itself are seen, and others may as well wait for the next drain.
+ */
+static bool need_lru_add_drain(int cpu)
+{
+	struct lru_add_cache *caches = per_cpu(lru_add_caches, cpu);
+	int lru;
+
+	for_each_lru(lru)
+		if (ACCESS_ONCE(caches[lru - LRU_BASE].nr))
+			return true;
+
+	return pagevec_count(&per_cpu(lru_rotate_pvecs, cpu)) ||
+	       pagevec_count(&per_cpu(lru_deactivate_pvecs, cpu)) ||
+	       need_activate_page_drain(cpu);
+}
+
 /*
+ * Drain the caches of every cpu.  Only the cpus that have something
+ * cached are sent work, rather than every online cpu, so that idle or
+ * isolated cpus are left alone.
+ *
  * Returns 0 for success
  */
 int lru_add_drain_all(void)
 {
-	return schedule_on_each_cpu(lru_add_drain_per_cpu);
+	static DEFINE_MUTEX(lock);
+	static struct cpumask has_work;
+	int cpu;
+
+	mutex_lock(&lock);
+	get_online_cpus();
+	cpumask_clear(&has_work);
+
+	for_each_online_cpu(cpu) {
+		struct work_struct *work = &per_cpu(lru_add_drain_work, cpu);
+
+		if (need_lru_add_drain(cpu)) {
+			INIT_WORK(work, lru_add_drain_per_cpu);
+			schedule_work_on(cpu, work);
+			cpumask_set_cpu(cpu, &has_work);
+		}
+	}
+
+	for_each_cpu(cpu, &has_work)
+		flush_work(&per_cpu(lru_add_drain_work, cpu));
+
+	put_online_cpus();
+	mutex_unlock(&lock);
+	return 0;
 }
 
 /*
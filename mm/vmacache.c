@@ -0,0 +1,172 @@
+/*
+ * Per-thread vma caching
+ *
+ * Each thread caches the last few vmas find_vma() returned for it, in a
+ * small array indexed by a hash of the page number.  This replaces the
+ * single mm->mmap_cache slot, which threads of the same process kept
+ * overwriting for each other.
+ *
+ * The caches are not invalidated one by one: removing a vma from an mm
+ * bumps mm->vmacache_seqnum, and a thread's cache is only trusted while
+ * its own vmacache_seqnum matches the mm's.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/rcupdate.h>
+#include <linux/vmacache.h>
+
+/*
+ * Flush vma caches for threads that share a given mm.
+ *
+ * The operation is safe because the caller holds the mmap_sem
+ * exclusively and other threads accessing the vma cache will
+ * have mmap_sem held at least for read, so no extra locking
+ * is required to maintain the vma cache.
+ */
+void vmacache_flush_all(struct mm_struct *mm)
+{
+	struct task_struct *g, *p;
+
+	/*
+	 * Single threaded tasks need not iterate the entire
+	 * list of process. We can avoid the flushing as well
+	 * since the mm's seqnum was increased and don't have
+	 * to worry about other threads' seqnum. Current's
+	 * flush will occur upon the next lookup.
+	 */
+	if (atomic_read(&mm->mm_users) == 1)
+		return;
+
+	rcu_read_lock();
+	do_each_thread(g, p) {
+		/*
+		 * Only flush the vmacache pointers as the
+		 * mm seqnum is already set and curr's will
+		 * be set upon invalidation when the next
+		 * lookup is done.
+		 */
+		if (mm == p->mm)
+			vmacache_flush(p);
+	} while_each_thread(g, p);
+	rcu_read_unlock();
+}
+
+/*
+ * This task may be accessing a foreign mm via (for example)
+ * get_user_pages()->find_vma().  The vmacache is task-local and this
+ * task's vmacache pertains to a different mm (ie, its own).  There is
+ * nothing we can do here.
+ *
+ * Also handle the case where a kernel thread has adopted this mm via
+ * use_mm().  That kernel thread's vmacache is not applicable to this mm.
+ */
+static bool vmacache_valid_mm(struct mm_struct *mm)
+{
+	return current->mm == mm && !(current->flags & PF_KTHREAD);
+}
+
+void vmacache_update(unsigned long addr, struct vm_area_struct *newvma)
+{
+	if (vmacache_valid_mm(newvma->vm_mm))
+		current->vmacache[VMACACHE_HASH(addr)] = newvma;
+}
+
+static bool vmacache_valid(struct mm_struct *mm)
+{
+	struct task_struct *curr;
+
+	if (!vmacache_valid_mm(mm))
+		return false;
+
+	curr = current;
+	if (mm->vmacache_seqnum != curr->vmacache_seqnum) {
+		/*
+		 * First attempt will always be invalid, initialize
+		 * the new cache for this task here.
+		 */
+		curr->vmacache_seqnum = mm->vmacache_seqnum;
+		vmacache_flush(curr);
+		return false;
+	}
+	return true;
+}
+
+struct vm_area_struct *vmacache_find(struct mm_struct *mm, unsigned long addr)
+{
+	int i;
+
+	if (!vmacache_valid(mm))
+		return NULL;
+
+	for (i = 0; i < VMACACHE_SIZE; i++) {
+		struct vm_area_struct *vma = current->vmacache[i];
+
+		if (!vma)
+			continue;
+		if (WARN_ON_ONCE(vma->vm_mm != mm))
+			break;
+		if (vma->vm_start <= addr && vma->vm_end > addr)
+			return vma;
+	}
+
+	return NULL;
+}
+
+#ifndef CONFIG_MMU
+struct vm_area_struct *vmacache_find_exact(struct mm_struct *mm,
+					   unsigned long start,
+					   unsigned long end)
+{
+	int i;
+
+	if (!vmacache_valid(mm))
+		return NULL;
+
+	for (i = 0; i < VMACACHE_SIZE; i++) {
+		struct vm_area_struct *vma = current->vmacache[i];
+
+		if (vma && vma->vm_start == start && vma->vm_end == end)
+			return vma;
+	}
+
+	return NULL;
+}
+#endif
+
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Lookup for the speculative page fault, without mmap_sem.  The caller
+ * must hold rcu_read_lock(): vmas are only freed through RCU, after the
+ * mm's seqnum has been bumped, so a vma found while the seqnum still
+ * matches stays allocated until rcu_read_unlock().  The seqnum is handed
+ * back so that the caller can check it again later.  The vma's fields,
+ * including the range it was matched on here, are only stable once its
+ * vm_sequence has been sampled, so the caller must check them again.
+ */
+struct vm_area_struct *vmacache_find_rcu(struct mm_struct *mm,
+					 unsigned long addr, u32 *seqnum)
+{
+	struct task_struct *curr = current;
+	int i;
+
+	if (!vmacache_valid_mm(mm))
+		return NULL;
+
+	*seqnum = ACCESS_ONCE(mm->vmacache_seqnum);
+	if (*seqnum != curr->vmacache_seqnum)
+		return NULL;
+	smp_rmb();
+
+	for (i = 0; i < VMACACHE_SIZE; i++) {
+		struct vm_area_struct *vma = ACCESS_ONCE(curr->vmacache[i]);
+
+		if (vma && vma->vm_mm == mm &&
+		    vma->vm_start <= addr && vma->vm_end > addr)
+			return vma;
+	}
+
+	return NULL;
+}
+#endif
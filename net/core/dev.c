@@ -135,6 +135,7 @@
 #include <linux/net_tstamp.h>
 #include <linux/static_key.h>
 #include <net/flow_keys.h>
+#include <net/busy_poll.h>
 
 #include "net-sysfs.h"
 
@@ -1600,12 +1601,10 @@ static inline bool is_skb_forwardable(struct net_device *dev,
  */
 int dev_forward_skb(struct net_device *dev, struct sk_buff *skb)
 {
-	if (skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY) {
-		if (skb_copy_ubufs(skb, GFP_ATOMIC)) {
-			atomic_long_inc(&dev->rx_dropped);
-			kfree_skb(skb);
-			return NET_RX_DROP;
-		}
+	if (skb_orphan_frags_rx(skb, GFP_ATOMIC)) {
+		atomic_long_inc(&dev->rx_dropped);
+		kfree_skb(skb);
+		return NET_RX_DROP;
 	}
 
 	skb_orphan(skb);
@@ -1629,6 +1628,8 @@ static inline int deliver_skb(struct sk_buff *skb,
 			      struct packet_type *pt_prev,
 			      struct net_device *orig_dev)
 {
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
+		return -ENOMEM;
 	atomic_inc(&skb->users);
 	return pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
 }
@@ -2021,6 +2022,104 @@ struct sk_buff *skb_gso_segment(struct sk_buff *skb,
 }
 EXPORT_SYMBOL(skb_gso_segment);
 
+/**
+ *	dev_find_offload - find the offload handlers of a protocol
+ *	@type: ethernet protocol of the packet
+ *
+ *	Tunnels use this to hand the packet they carry to the GRO and GSO
+ *	handlers of its protocol.  Must be called under rcu_read_lock().
+ */
+struct packet_type *dev_find_offload(__be16 type)
+{
+	struct list_head *head = &ptype_base[ntohs(type) & PTYPE_HASH_MASK];
+	struct packet_type *ptype;
+
+	list_for_each_entry_rcu(ptype, head, list) {
+		if (ptype->type == type && !ptype->dev &&
+		    (ptype->gso_segment || ptype->gro_receive))
+			return ptype;
+	}
+	return NULL;
+}
+EXPORT_SYMBOL(dev_find_offload);
+
+/**
+ *	skb_network_gso_send_check - prepare an encapsulated packet for GSO
+ *	@skb: buffer with data pointing at the encapsulated network header
+ *	@type: ethernet protocol of the encapsulated packet
+ *
+ *	The network header of @skb is left where it was.
+ */
+int skb_network_gso_send_check(struct sk_buff *skb, __be16 type)
+{
+	struct packet_type *ptype;
+	int nhoff = skb_network_offset(skb);
+	int err = -EPROTONOSUPPORT;
+
+	skb_reset_network_header(skb);
+
+	rcu_read_lock();
+	ptype = dev_find_offload(type);
+	if (ptype && ptype->gso_send_check)
+		err = ptype->gso_send_check(skb);
+	rcu_read_unlock();
+
+	skb_set_network_header(skb, nhoff);
+	return err;
+}
+EXPORT_SYMBOL(skb_network_gso_send_check);
+
+/**
+ *	skb_network_gso_segment - segment an encapsulated packet
+ *	@skb: buffer with data pointing at the encapsulated network header
+ *	@features: features of the output device
+ *	@type: ethernet protocol of the encapsulated packet
+ *
+ *	Segments are built with all headers in front of the encapsulated
+ *	packet copied, and are left for the caller to fix up the outer
+ *	headers.  The inner checksum is filled in here unless the device
+ *	can checksum from csum_start.
+ */
+struct sk_buff *skb_network_gso_segment(struct sk_buff *skb,
+					netdev_features_t features,
+					__be16 type)
+{
+	struct sk_buff *segs = ERR_PTR(-EPROTONOSUPPORT);
+	struct sk_buff *seg;
+	struct packet_type *ptype;
+	int err;
+
+	skb_reset_network_header(skb);
+
+	rcu_read_lock();
+	ptype = dev_find_offload(type);
+	if (ptype && ptype->gso_segment)
+		segs = ptype->gso_segment(skb, (features & NETIF_F_SG) |
+						NETIF_F_HW_CSUM);
+	rcu_read_unlock();
+
+	if (!segs || IS_ERR(segs) || (features & NETIF_F_HW_CSUM))
+		return segs;
+
+	for (seg = segs; seg; seg = seg->next) {
+		if (seg->ip_summed != CHECKSUM_PARTIAL)
+			continue;
+
+		err = skb_checksum_help(seg);
+		if (unlikely(err)) {
+			while (segs) {
+				seg = segs;
+				segs = segs->next;
+				kfree_skb(seg);
+			}
+			return ERR_PTR(err);
+		}
+	}
+
+	return segs;
+}
+EXPORT_SYMBOL(skb_network_gso_segment);
+
 /* Take action when hardware reception checksum errors are detected. */
 #ifdef CONFIG_BUG
 void netdev_rx_csum_fault(struct net_device *dev)
@@ -2117,25 +2216,6 @@ static int dev_gso_segment(struct sk_buff *skb, netdev_features_t features)
 	return 0;
 }
 
-/*
- * Try to orphan skb early, right before transmission by the device.
- * We cannot orphan skb if tx timestamp is requested or the sk-reference
- * is needed on driver level for other reasons, e.g. see net/can/raw.c
- */
-static inline void skb_orphan_try(struct sk_buff *skb)
-{
-	struct sock *sk = skb->sk;
-
-	if (sk && !skb_shinfo(skb)->tx_flags) {
-		/* skb_tx_hash() wont be able to get sk.
-		 * We copy sk_hash into skb->rxhash
-		 */
-		if (!skb->rxhash)
-			skb->rxhash = sk->sk_hash;
-		skb_orphan(skb);
-	}
-}
-
 static bool can_checksum_protocol(netdev_features_t features, __be16 protocol)
 {
 	return ((features & NETIF_F_GEN_CSUM) ||
@@ -2221,8 +2301,6 @@ int dev_hard_start_xmit(struct sk_buff *skb, struct net_device *dev,
 		if (!list_empty(&ptype_all))
 			dev_queue_xmit_nit(skb, dev);
 
-		skb_orphan_try(skb);
-
 		features = netif_skb_features(skb);
 
 		if (vlan_tx_tag_present(skb) &&
@@ -3191,8 +3269,6 @@ static int __netif_receive_skb(struct sk_buff *skb)
 	if (netpoll_receive_skb(skb))
 		return NET_RX_DROP;
 
-	if (!skb->skb_iif)
-		skb->skb_iif = skb->dev->ifindex;
 	orig_dev = skb->dev;
 
 	skb_reset_network_header(skb);
@@ -3204,6 +3280,10 @@ static int __netif_receive_skb(struct sk_buff *skb)
 	rcu_read_lock();
 
 another_round:
+	/* The IPv4 input routes are shared by every interface feeding
+	 * a nexthop, inet_iif() relies on this being the upper device.
+	 */
+	skb->skb_iif = skb->dev->ifindex;
 
 	__this_cpu_inc(softnet_data.processed);
 
@@ -3282,8 +3362,11 @@ ncls:
 	}
 
 	if (pt_prev) {
+		if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
+			goto drop;
 		ret = pt_prev->func(skb, skb->dev, pt_prev, orig_dev);
 	} else {
+drop:
 		atomic_long_inc(&skb->dev->rx_dropped);
 		kfree_skb(skb);
 		/* Jamal, now you will not able to escape explaining
@@ -3385,7 +3468,7 @@ static int napi_gro_complete(struct sk_buff *skb)
 		if (ptype->type != type || ptype->dev || !ptype->gro_complete)
 			continue;
 
-		err = ptype->gro_complete(skb);
+		err = ptype->gro_complete(skb, 0);
 		break;
 	}
 	rcu_read_unlock();
@@ -3442,6 +3525,7 @@ enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 		NAPI_GRO_CB(skb)->same_flow = 0;
 		NAPI_GRO_CB(skb)->flush = 0;
 		NAPI_GRO_CB(skb)->free = 0;
+		NAPI_GRO_CB(skb)->encap_mark = 0;
 
 		pp = ptype->gro_receive(&napi->gro_list, skb);
 		break;
@@ -3778,11 +3862,280 @@ void __napi_schedule(struct napi_struct *n)
 }
 EXPORT_SYMBOL(__napi_schedule);
 
+/*
+ * Adaptive interrupt moderation.
+ *
+ * For devices that implement ndo_set_napi_coalesce() and have it turned
+ * on (IFF_NAPI_DIM, off by default, drivers map it to their adaptive-rx
+ * ethtool setting) the core samples the byte, packet and completion
+ * (i.e. interrupt) rate of every NAPI context and walks a small table
+ * of coalescing profiles, ordered from lowest latency to highest
+ * moderation.  A step is kept as long as it makes the sample better -
+ * more bytes or packets, or the same traffic with fewer interrupts -
+ * and reverted otherwise.  Once the best profile is found the engine
+ * parks there until the traffic pattern changes.
+ */
+#define NAPI_DIM_NEVENTS	64
+#define NAPI_DIM_DEF_PROFILE	1
+#define NAPI_DIM_SIGNIFICANT(val, ref) \
+	((ref) && div_u64(100ULL * abs((int)(val) - (int)(ref)), (ref)) > 10)
+
+struct napi_dim_profile {
+	unsigned int	usecs;
+	unsigned int	frames;
+};
+
+static const struct napi_dim_profile napi_dim_profiles[] = {
+	{   2,   8 },
+	{   8,  16 },
+	{  32,  32 },
+	{  64,  64 },
+	{ 128, 128 },
+};
+#define NAPI_DIM_NPROFILES	ARRAY_SIZE(napi_dim_profiles)
+
+enum {
+	NAPI_DIM_PARKING_ON_TOP,
+	NAPI_DIM_PARKING_TIRED,
+	NAPI_DIM_GOING_RIGHT,
+	NAPI_DIM_GOING_LEFT,
+};
+
+enum {
+	NAPI_DIM_STATS_WORSE,
+	NAPI_DIM_STATS_SAME,
+	NAPI_DIM_STATS_BETTER,
+};
+
+enum {
+	NAPI_DIM_STEPPED,
+	NAPI_DIM_TOO_TIRED,
+	NAPI_DIM_ON_EDGE,
+};
+
+static int napi_dim_step(struct napi_dim *dim)
+{
+	if (dim->tired == NAPI_DIM_NPROFILES * 2)
+		return NAPI_DIM_TOO_TIRED;
+
+	switch (dim->tune_state) {
+	case NAPI_DIM_PARKING_ON_TOP:
+	case NAPI_DIM_PARKING_TIRED:
+		break;
+	case NAPI_DIM_GOING_RIGHT:
+		if (dim->profile_ix == NAPI_DIM_NPROFILES - 1)
+			return NAPI_DIM_ON_EDGE;
+		dim->profile_ix++;
+		dim->steps_right++;
+		break;
+	case NAPI_DIM_GOING_LEFT:
+		if (dim->profile_ix == 0)
+			return NAPI_DIM_ON_EDGE;
+		dim->profile_ix--;
+		dim->steps_left++;
+		break;
+	}
+
+	dim->tired++;
+	return NAPI_DIM_STEPPED;
+}
+
+static void napi_dim_park_on_top(struct napi_dim *dim)
+{
+	dim->steps_right = 0;
+	dim->steps_left = 0;
+	dim->tired = 0;
+	dim->tune_state = NAPI_DIM_PARKING_ON_TOP;
+}
+
+static void napi_dim_park_tired(struct napi_dim *dim)
+{
+	dim->steps_right = 0;
+	dim->steps_left = 0;
+	dim->tune_state = NAPI_DIM_PARKING_TIRED;
+}
+
+static void napi_dim_exit_parking(struct napi_dim *dim)
+{
+	dim->tune_state = dim->profile_ix ? NAPI_DIM_GOING_LEFT :
+					    NAPI_DIM_GOING_RIGHT;
+	napi_dim_step(dim);
+}
+
+static bool napi_dim_on_top(const struct napi_dim *dim)
+{
+	switch (dim->tune_state) {
+	case NAPI_DIM_PARKING_ON_TOP:
+	case NAPI_DIM_PARKING_TIRED:
+		return true;
+	case NAPI_DIM_GOING_RIGHT:
+		return dim->steps_left > 1 && dim->steps_right == 1;
+	default: /* NAPI_DIM_GOING_LEFT */
+		return dim->steps_right > 1 && dim->steps_left == 1;
+	}
+}
+
+static void napi_dim_turn(struct napi_dim *dim)
+{
+	switch (dim->tune_state) {
+	case NAPI_DIM_PARKING_ON_TOP:
+	case NAPI_DIM_PARKING_TIRED:
+		break;
+	case NAPI_DIM_GOING_RIGHT:
+		dim->tune_state = NAPI_DIM_GOING_LEFT;
+		dim->steps_left = 0;
+		break;
+	case NAPI_DIM_GOING_LEFT:
+		dim->tune_state = NAPI_DIM_GOING_RIGHT;
+		dim->steps_right = 0;
+		break;
+	}
+}
+
+static int napi_dim_stats_compare(const struct napi_dim *dim,
+				  u32 bpms, u32 ppms, u32 epms)
+{
+	if (!dim->prev_ppms)
+		return ppms ? NAPI_DIM_STATS_BETTER : NAPI_DIM_STATS_SAME;
+
+	if (NAPI_DIM_SIGNIFICANT(bpms, dim->prev_bpms))
+		return bpms > dim->prev_bpms ? NAPI_DIM_STATS_BETTER :
+					       NAPI_DIM_STATS_WORSE;
+
+	if (NAPI_DIM_SIGNIFICANT(ppms, dim->prev_ppms))
+		return ppms > dim->prev_ppms ? NAPI_DIM_STATS_BETTER :
+					       NAPI_DIM_STATS_WORSE;
+
+	if (NAPI_DIM_SIGNIFICANT(epms, dim->prev_epms))
+		return epms < dim->prev_epms ? NAPI_DIM_STATS_BETTER :
+					       NAPI_DIM_STATS_WORSE;
+
+	return NAPI_DIM_STATS_SAME;
+}
+
+/* Returns true if a new profile has been selected. */
+static bool napi_dim_decide(struct napi_dim *dim, u32 bpms, u32 ppms,
+			    u32 epms)
+{
+	int prev_state = dim->tune_state;
+	int prev_ix = dim->profile_ix;
+	int stats_res;
+
+	switch (dim->tune_state) {
+	case NAPI_DIM_PARKING_ON_TOP:
+		stats_res = napi_dim_stats_compare(dim, bpms, ppms, epms);
+		if (stats_res != NAPI_DIM_STATS_SAME)
+			napi_dim_exit_parking(dim);
+		break;
+
+	case NAPI_DIM_PARKING_TIRED:
+		if (!--dim->tired)
+			napi_dim_exit_parking(dim);
+		break;
+
+	case NAPI_DIM_GOING_RIGHT:
+	case NAPI_DIM_GOING_LEFT:
+		stats_res = napi_dim_stats_compare(dim, bpms, ppms, epms);
+		if (stats_res != NAPI_DIM_STATS_BETTER)
+			napi_dim_turn(dim);
+
+		if (napi_dim_on_top(dim)) {
+			napi_dim_park_on_top(dim);
+			break;
+		}
+
+		switch (napi_dim_step(dim)) {
+		case NAPI_DIM_TOO_TIRED:
+			napi_dim_park_tired(dim);
+			break;
+		case NAPI_DIM_ON_EDGE:
+			napi_dim_park_on_top(dim);
+			break;
+		}
+		break;
+	}
+
+	/* Keep the reference sample while parked so that slow drift is
+	 * still noticed.
+	 */
+	if (prev_state != NAPI_DIM_PARKING_ON_TOP ||
+	    dim->tune_state != NAPI_DIM_PARKING_ON_TOP) {
+		dim->prev_bpms = bpms;
+		dim->prev_ppms = ppms;
+		dim->prev_epms = epms;
+	}
+
+	return dim->profile_ix != prev_ix;
+}
+
+static void napi_dim_sample(struct napi_struct *n)
+{
+	struct napi_dim *dim = &n->dim;
+	ktime_t now;
+	s64 delta_us;
+
+	if (++dim->events < NAPI_DIM_NEVENTS)
+		return;
+
+	now = ktime_get();
+	delta_us = ktime_us_delta(now, dim->start);
+	if (dim->start.tv64 && delta_us > 0 && delta_us < UINT_MAX) {
+		u32 bpms, ppms, epms;
+
+		bpms = div_u64(dim->bytes * USEC_PER_MSEC, (u32)delta_us);
+		ppms = div_u64((u64)dim->pkts * USEC_PER_MSEC, (u32)delta_us);
+		epms = div_u64((u64)dim->events * USEC_PER_MSEC, (u32)delta_us);
+		if (napi_dim_decide(dim, bpms, ppms, epms))
+			schedule_work(&dim->work);
+	}
+
+	dim->start = now;
+	dim->bytes = 0;
+	dim->pkts = 0;
+	dim->events = 0;
+}
+
+static void napi_dim_work(struct work_struct *work)
+{
+	struct napi_dim *dim = container_of(work, struct napi_dim, work);
+	struct napi_struct *n = container_of(dim, struct napi_struct, dim);
+	const struct net_device_ops *ops = n->dev->netdev_ops;
+	const struct napi_dim_profile *prof;
+
+	if (!(n->dev->priv_flags & IFF_NAPI_DIM) ||
+	    !ops->ndo_set_napi_coalesce)
+		return;
+
+	prof = &napi_dim_profiles[ACCESS_ONCE(dim->profile_ix)];
+	ops->ndo_set_napi_coalesce(n, prof->usecs, prof->frames);
+}
+
+static void napi_dim_init(struct napi_struct *n)
+{
+	struct napi_dim *dim = &n->dim;
+
+	dim->start.tv64 = 0;
+	dim->bytes = 0;
+	dim->pkts = 0;
+	dim->events = 0;
+	dim->prev_bpms = 0;
+	dim->prev_ppms = 0;
+	dim->prev_epms = 0;
+	dim->profile_ix = NAPI_DIM_DEF_PROFILE;
+	dim->tune_state = NAPI_DIM_GOING_RIGHT;
+	dim->steps_left = 0;
+	dim->steps_right = 0;
+	dim->tired = 0;
+}
+
 void __napi_complete(struct napi_struct *n)
 {
 	BUG_ON(!test_bit(NAPI_STATE_SCHED, &n->state));
 	BUG_ON(n->gro_list);
 
+	if (n->dev->priv_flags & IFF_NAPI_DIM)
+		napi_dim_sample(n);
+
 	list_del(&n->poll_list);
 	smp_mb__before_clear_bit();
 	clear_bit(NAPI_STATE_SCHED, &n->state);
@@ -3807,6 +4160,13 @@ void napi_complete(struct napi_struct *n)
 }
 EXPORT_SYMBOL(napi_complete);
 
+void napi_complete_done(struct napi_struct *n, int work_done)
+{
+	n->dim.pkts += work_done;
+	napi_complete(n);
+}
+EXPORT_SYMBOL(napi_complete_done);
+
 void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 		    int (*poll)(struct napi_struct *, int), int weight)
 {
@@ -3822,6 +4182,8 @@ void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 	spin_lock_init(&napi->poll_lock);
 	napi->poll_owner = -1;
 #endif
+	napi_dim_init(napi);
+	INIT_WORK(&napi->dim.work, napi_dim_work);
 	set_bit(NAPI_STATE_SCHED, &napi->state);
 }
 EXPORT_SYMBOL(netif_napi_add);
@@ -3833,6 +4195,9 @@ void netif_napi_del(struct napi_struct *napi)
 	list_del_init(&napi->dev_list);
 	napi_free_frags(napi);
 
+	if (napi->dev->netdev_ops->ndo_set_napi_coalesce)
+		cancel_work_sync(&napi->dim.work);
+
 	for (skb = napi->gro_list; skb; skb = next) {
 		next = skb->next;
 		skb->next = NULL;
@@ -3844,6 +4209,123 @@ void netif_napi_del(struct napi_struct *napi)
 }
 EXPORT_SYMBOL(netif_napi_del);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+#define NAPI_HASH_BITS	8
+#define NAPI_HASH_SIZE	(1 << NAPI_HASH_BITS)
+
+unsigned int sysctl_net_busy_read __read_mostly;
+unsigned int sysctl_net_busy_poll __read_mostly;
+
+static DEFINE_SPINLOCK(napi_hash_lock);
+static unsigned int napi_gen_id;
+static struct hlist_head napi_hash[NAPI_HASH_SIZE];
+
+/* must be called under rcu_read_lock(), as we dont take a reference */
+struct napi_struct *napi_by_id(unsigned int napi_id)
+{
+	struct hlist_head *head = &napi_hash[napi_id % NAPI_HASH_SIZE];
+	struct napi_struct *napi;
+	struct hlist_node *node;
+
+	hlist_for_each_entry_rcu(napi, node, head, napi_hash_node)
+		if (napi->napi_id == napi_id)
+			return napi;
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(napi_by_id);
+
+void napi_hash_add(struct napi_struct *napi)
+{
+	if (test_and_set_bit(NAPI_STATE_HASHED, &napi->state))
+		return;
+
+	spin_lock(&napi_hash_lock);
+
+	/* 0 is not a valid id, we also skip an id that is taken
+	 * we expect both events to be extremely rare
+	 */
+	napi->napi_id = 0;
+	while (!napi->napi_id) {
+		napi->napi_id = ++napi_gen_id;
+		if (napi_by_id(napi->napi_id))
+			napi->napi_id = 0;
+	}
+
+	hlist_add_head_rcu(&napi->napi_hash_node,
+			   &napi_hash[napi->napi_id % NAPI_HASH_SIZE]);
+
+	spin_unlock(&napi_hash_lock);
+}
+EXPORT_SYMBOL_GPL(napi_hash_add);
+
+/* Warning : caller is responsible to make sure rcu grace period
+ * is respected before freeing memory containing @napi
+ */
+void napi_hash_del(struct napi_struct *napi)
+{
+	spin_lock(&napi_hash_lock);
+
+	if (test_and_clear_bit(NAPI_STATE_HASHED, &napi->state))
+		hlist_del_rcu(&napi->napi_hash_node);
+
+	spin_unlock(&napi_hash_lock);
+}
+EXPORT_SYMBOL_GPL(napi_hash_del);
+
+/**
+ *	sk_busy_loop - poll the device queue a socket receives from
+ *	@sk: socket
+ *	@nonblock: only poll once, don't spin until data arrives
+ *
+ * Calls the driver's ndo_busy_poll() for the NAPI context the last
+ * packet of @sk came in on, for at most sk->sk_ll_usec microseconds or
+ * until data shows up on the socket receive queue.
+ *
+ * Returns true if the receive queue is not empty on exit.
+ */
+bool sk_busy_loop(struct sock *sk, int nonblock)
+{
+	unsigned long end_time = !nonblock ? busy_loop_us_clock() +
+					     ACCESS_ONCE(sk->sk_ll_usec) : 0;
+	const struct net_device_ops *ops;
+	struct napi_struct *napi;
+	int rc = false;
+
+	rcu_read_lock();
+	local_bh_disable();
+
+	napi = napi_by_id(sk->sk_napi_id);
+	if (!napi)
+		goto out;
+
+	ops = napi->dev->netdev_ops;
+	if (!ops->ndo_busy_poll)
+		goto out;
+
+	do {
+		rc = ops->ndo_busy_poll(napi);
+
+		if (rc == LL_FLUSH_FAILED)
+			break; /* permanent failure */
+
+		if (rc > 0)
+			/* local bh are disabled so it is ok to use _BH */
+			NET_ADD_STATS_BH(sock_net(sk),
+					 LINUX_MIB_BUSYPOLLRXPACKETS, rc);
+
+	} while (!nonblock && skb_queue_empty(&sk->sk_receive_queue) &&
+		 !need_resched() && !busy_loop_timeout(end_time));
+
+	rc = !skb_queue_empty(&sk->sk_receive_queue);
+out:
+	local_bh_enable();
+	rcu_read_unlock();
+	return rc;
+}
+EXPORT_SYMBOL(sk_busy_loop);
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 static void net_rx_action(struct softirq_action *h)
 {
 	struct softnet_data *sd = &__get_cpu_var(softnet_data);
@@ -3901,6 +4383,8 @@ static void net_rx_action(struct softirq_action *h)
 		 * move the instance around on the list at-will.
 		 */
 		if (unlikely(work == weight)) {
+			/* Still owned by us, see above. */
+			n->dim.pkts += work;
 			if (unlikely(napi_disable_pending(n))) {
 				local_irq_enable();
 				napi_complete(n);
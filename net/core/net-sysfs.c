@@ -256,6 +256,36 @@ static ssize_t store_tx_queue_len(struct device *dev,
 	return netdev_store(dev, attr, buf, len, change_tx_queue_len);
 }
 
+static ssize_t format_napi_dim(const struct net_device *net, char *buf)
+{
+	return sprintf(buf, fmt_dec, !!(net->priv_flags & IFF_NAPI_DIM));
+}
+
+static ssize_t show_napi_dim(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	return netdev_show(dev, attr, buf, format_napi_dim);
+}
+
+static int change_napi_dim(struct net_device *net, unsigned long enable)
+{
+	if (!net->netdev_ops->ndo_set_napi_coalesce)
+		return -EOPNOTSUPP;
+
+	if (enable)
+		net->priv_flags |= IFF_NAPI_DIM;
+	else
+		net->priv_flags &= ~IFF_NAPI_DIM;
+	return 0;
+}
+
+static ssize_t store_napi_dim(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t len)
+{
+	return netdev_store(dev, attr, buf, len, change_napi_dim);
+}
+
 static ssize_t store_ifalias(struct device *dev, struct device_attribute *attr,
 			     const char *buf, size_t len)
 {
@@ -327,6 +357,7 @@ static struct device_attribute net_class_attributes[] = {
 	__ATTR(tx_queue_len, S_IRUGO | S_IWUSR, show_tx_queue_len,
 	       store_tx_queue_len),
 	__ATTR(netdev_group, S_IRUGO | S_IWUSR, show_group, store_group),
+	__ATTR(napi_dim, S_IRUGO | S_IWUSR, show_napi_dim, store_napi_dim),
 	{}
 };
 
@@ -207,7 +207,6 @@ struct sock *dccp_check_req(struct sock *sk, struct sk_buff *skb,
 		goto listen_overflow;
 
 	inet_csk_reqsk_queue_unlink(sk, req, prev);
-	inet_csk_reqsk_queue_removed(sk, req);
 	inet_csk_reqsk_queue_add(sk, req, child);
 out:
 	return child;
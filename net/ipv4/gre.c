@@ -18,8 +18,11 @@
 #include <linux/skbuff.h>
 #include <linux/in.h>
 #include <linux/ip.h>
+#include <linux/if_ether.h>
 #include <linux/netdevice.h>
+#include <linux/if_tunnel.h>
 #include <linux/spinlock.h>
+#include <net/checksum.h>
 #include <net/protocol.h>
 #include <net/gre.h>
 
@@ -112,9 +115,224 @@ static void gre_err(struct sk_buff *skb, u32 info)
 	rcu_read_unlock();
 }
 
+static unsigned int gre_hdr_len(__be16 flags)
+{
+	unsigned int len = 4;
+
+	if (flags & GRE_CSUM)
+		len += 4;
+	if (flags & GRE_KEY)
+		len += 4;
+	if (flags & GRE_SEQ)
+		len += 4;
+	return len;
+}
+
+/*
+ * Pull the GRE header, and the Ethernet header of a bridged packet, off
+ * a packet that is to be segmented.  Sequence numbers would have to
+ * differ between segments, so only the checksum and key are allowed.
+ */
+static int gre_gso_pull(struct sk_buff *skb, __be16 *flags, __be16 *type)
+{
+	const __be16 *greh;
+	unsigned int grehlen;
+
+	if (unlikely(!pskb_may_pull(skb, 4)))
+		return -EINVAL;
+
+	greh = (const __be16 *)skb->data;
+	if (greh[0] & ~(GRE_CSUM | GRE_KEY))
+		return -EINVAL;
+
+	grehlen = gre_hdr_len(greh[0]);
+	if (unlikely(!pskb_may_pull(skb, grehlen)))
+		return -EINVAL;
+
+	greh = (const __be16 *)skb->data;
+	*flags = greh[0];
+	*type = greh[1];
+	__skb_pull(skb, grehlen);
+
+	if (*type == htons(ETH_P_TEB)) {
+		if (unlikely(!pskb_may_pull(skb, ETH_HLEN)))
+			return -EINVAL;
+		*type = ((struct ethhdr *)skb->data)->h_proto;
+		__skb_pull(skb, ETH_HLEN);
+	}
+
+	return 0;
+}
+
+static int gre_gso_send_check(struct sk_buff *skb)
+{
+	__be16 flags, type;
+	int err;
+
+	err = gre_gso_pull(skb, &flags, &type);
+	if (err)
+		return err;
+
+	return skb_network_gso_send_check(skb, type);
+}
+
+static struct sk_buff *gre_gso_segment(struct sk_buff *skb,
+				       netdev_features_t features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	struct sk_buff *seg;
+	unsigned int goff;
+	__be16 flags, type;
+
+	if (unlikely(skb_shinfo(skb)->gso_type &
+		     ~(SKB_GSO_TCPV4 |
+		       SKB_GSO_TCPV6 |
+		       SKB_GSO_TCP_ECN |
+		       SKB_GSO_UDP_L4 |
+		       SKB_GSO_DODGY |
+		       SKB_GSO_GRE |
+		       0)))
+		goto out;
+
+	goff = skb->data - skb_mac_header(skb);
+	if (gre_gso_pull(skb, &flags, &type))
+		goto out;
+
+	/* The GRE checksum covers the inner one, which must be done first. */
+	if (flags & GRE_CSUM)
+		features &= ~NETIF_F_HW_CSUM;
+
+	segs = skb_network_gso_segment(skb, features, type);
+	if (!segs || IS_ERR(segs) || !(flags & GRE_CSUM))
+		goto out;
+
+	for (seg = segs; seg; seg = seg->next) {
+		__sum16 *csum = (__sum16 *)(skb_mac_header(seg) + goff + 4);
+
+		*csum = 0;
+		*csum = csum_fold(skb_checksum(seg, goff, seg->len - goff, 0));
+	}
+
+out:
+	return segs;
+}
+
+/*
+ * Only version 0 GRE with an optional checksum and key is merged, a
+ * sequence number would have to be checked for every packet.  The
+ * checksum is verified here so that the merged packet needs none.
+ */
+static struct sk_buff **gre_gro_receive(struct sk_buff **head,
+					struct sk_buff *skb)
+{
+	struct sk_buff **pp = NULL;
+	struct packet_type *ptype;
+	struct sk_buff *p;
+	const __be16 *greh;
+	unsigned int hlen, off;
+	unsigned int grehlen;
+	__be16 flags, type;
+	int flush = 1;
+	__wsum csum;
+
+	if (NAPI_GRO_CB(skb)->encap_mark)
+		goto out;
+
+	off = skb_gro_offset(skb);
+	hlen = off + 4;
+	greh = skb_gro_header_fast(skb, off);
+	if (skb_gro_header_hard(skb, hlen)) {
+		greh = skb_gro_header_slow(skb, hlen, off);
+		if (unlikely(!greh))
+			goto out;
+	}
+
+	if (greh[0] & ~(GRE_CSUM | GRE_KEY))
+		goto out;
+
+	grehlen = gre_hdr_len(greh[0]);
+	hlen = off + grehlen;
+	if (skb_gro_header_hard(skb, hlen)) {
+		greh = skb_gro_header_slow(skb, hlen, off);
+		if (unlikely(!greh))
+			goto out;
+	}
+
+	flags = greh[0];
+	type = greh[1];
+
+	rcu_read_lock();
+	ptype = dev_find_offload(type);
+	if (!ptype || !ptype->gro_receive)
+		goto out_unlock;
+
+	/*
+	 * The outer IP header sums to zero, so skb->csum is the checksum
+	 * of the GRE header and payload.
+	 */
+	skb_gro_tunnel_csum(skb);
+	if ((flags & GRE_CSUM) && csum_fold(skb->csum))
+		goto out_unlock;
+
+	for (p = *head; p; p = p->next) {
+		const __be16 *greh2;
+
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		greh2 = skb_gro_held_header(p, skb, off);
+
+		/* The key, if any, is the last word of the header. */
+		if ((greh[0] ^ greh2[0]) | (greh[1] ^ greh2[1]) ||
+		    ((flags & GRE_KEY) &&
+		     *(__be32 *)(greh + grehlen / 2 - 2) !=
+		     *(__be32 *)(greh2 + grehlen / 2 - 2)))
+			NAPI_GRO_CB(p)->same_flow = 0;
+	}
+
+	flush = 0;
+	NAPI_GRO_CB(skb)->encap_mark = 1;
+	skb_gro_pull(skb, grehlen);
+
+	csum = skb->csum;
+	skb_postpull_rcsum(skb, greh, grehlen);
+
+	pp = ptype->gro_receive(head, skb);
+
+	skb->csum = csum;
+
+out_unlock:
+	rcu_read_unlock();
+out:
+	NAPI_GRO_CB(skb)->flush |= flush;
+
+	return pp;
+}
+
+static int gre_gro_complete(struct sk_buff *skb, int nhoff)
+{
+	const __be16 *greh = (const __be16 *)(skb->data + nhoff);
+	struct packet_type *ptype;
+	int err = -ENOENT;
+
+	rcu_read_lock();
+	ptype = dev_find_offload(greh[1]);
+	if (ptype && ptype->gro_complete)
+		err = ptype->gro_complete(skb, nhoff + gre_hdr_len(greh[0]));
+	rcu_read_unlock();
+
+	skb_shinfo(skb)->gso_type |= SKB_GSO_GRE;
+
+	return err;
+}
+
 static const struct net_protocol net_gre_protocol = {
 	.handler     = gre_rcv,
 	.err_handler = gre_err,
+	.gso_send_check = gre_gso_send_check,
+	.gso_segment = gre_gso_segment,
+	.gro_receive = gre_gro_receive,
+	.gro_complete = gre_gro_complete,
 	.netns_ok    = 1,
 };
 
@@ -0,0 +1,88 @@
+/*
+ * IPv4 address family support for nf_tables.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/ip.h>
+#include <linux/netfilter_ipv4.h>
+#include <net/netfilter/nf_tables.h>
+#include <net/ip.h>
+
+static unsigned int nft_ipv4_hook(unsigned int hooknum,
+				  struct sk_buff *skb,
+				  const struct net_device *in,
+				  const struct net_device *out,
+				  int (*okfn)(struct sk_buff *));
+
+static struct nft_af_info nft_af_ipv4 __read_mostly = {
+	.family		= NFPROTO_IPV4,
+	.nhooks		= NF_INET_NUMHOOKS,
+	.owner		= THIS_MODULE,
+	.hooks		= {
+		[NF_INET_PRE_ROUTING]	= {
+			.hook		= nft_ipv4_hook,
+			.priority	= NF_IP_PRI_FILTER,
+		},
+		[NF_INET_LOCAL_IN]	= {
+			.hook		= nft_ipv4_hook,
+			.priority	= NF_IP_PRI_FILTER,
+		},
+		[NF_INET_FORWARD]	= {
+			.hook		= nft_ipv4_hook,
+			.priority	= NF_IP_PRI_FILTER,
+		},
+		[NF_INET_LOCAL_OUT]	= {
+			.hook		= nft_ipv4_hook,
+			.priority	= NF_IP_PRI_FILTER,
+		},
+		[NF_INET_POST_ROUTING]	= {
+			.hook		= nft_ipv4_hook,
+			.priority	= NF_IP_PRI_FILTER,
+		},
+	},
+};
+
+static unsigned int nft_ipv4_hook(unsigned int hooknum,
+				  struct sk_buff *skb,
+				  const struct net_device *in,
+				  const struct net_device *out,
+				  int (*okfn)(struct sk_buff *))
+{
+	struct nft_pktinfo pkt;
+
+	/* root is playing with raw sockets. */
+	if (hooknum == NF_INET_LOCAL_OUT &&
+	    (skb->len < sizeof(struct iphdr) ||
+	     ip_hdrlen(skb) < sizeof(struct iphdr)))
+		return NF_ACCEPT;
+
+	pkt.skb		= skb;
+	pkt.in		= in;
+	pkt.out		= out;
+	pkt.hooknum	= hooknum;
+	pkt.nhoff	= skb_network_offset(skb);
+	pkt.thoff	= pkt.nhoff + ip_hdrlen(skb);
+
+	return nft_do_hook(&nft_af_ipv4, &pkt);
+}
+
+static int __init nf_tables_ipv4_init(void)
+{
+	return nft_register_afinfo(&nft_af_ipv4);
+}
+
+static void __exit nf_tables_ipv4_exit(void)
+{
+	nft_unregister_afinfo(&nft_af_ipv4);
+}
+
+module_init(nf_tables_ipv4_init);
+module_exit(nf_tables_ipv4_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_NFT_FAMILY(AF_INET);
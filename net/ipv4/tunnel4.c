@@ -11,6 +11,7 @@
 #include <linux/slab.h>
 #include <net/icmp.h>
 #include <net/ip.h>
+#include <net/ipip.h>
 #include <net/protocol.h>
 #include <net/xfrm.h>
 
@@ -148,6 +149,10 @@ static void tunnel64_err(struct sk_buff *skb, u32 info)
 static const struct net_protocol tunnel4_protocol = {
 	.handler	=	tunnel4_rcv,
 	.err_handler	=	tunnel4_err,
+	.gso_send_check	=	ipip_gso_send_check,
+	.gso_segment	=	ipip_gso_segment,
+	.gro_receive	=	ipip_gro_receive,
+	.gro_complete	=	ipip_gro_complete,
 	.no_policy	=	1,
 	.netns_ok	=	1,
 };
@@ -0,0 +1,333 @@
+/*
+ * nf_tables hash set backend.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Lookups run under RCU, updates are serialized by the nfnetlink mutex.
+ * The table is doubled once it is three quarters full. Every element
+ * carries two hash nodes, so it can be linked into the new table while
+ * readers still walk the old one; the old table is freed after a grace
+ * period.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/list.h>
+#include <linux/rculist.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables.h>
+
+#define NFT_HASH_MIN_SIZE	4
+
+struct nft_hash_table {
+	unsigned int			size;
+	unsigned int			idx;
+	struct hlist_head		buckets[];
+};
+
+struct nft_hash {
+	struct nft_hash_table __rcu	*tbl;
+	unsigned int			nelems;
+	u32				seed;
+};
+
+struct nft_hash_elem {
+	struct hlist_node		hnode[2];
+	struct rcu_head			rcu;
+	struct nft_data			key;
+	struct nft_data			data[];
+};
+
+/* Updates are only made with the nfnetlink mutex held */
+#define nft_dereference(p)	rcu_dereference_protected(p, 1)
+
+static inline struct nft_hash_elem *nft_hash_entry(struct hlist_node *node,
+						   unsigned int idx)
+{
+	return container_of(node - idx, struct nft_hash_elem, hnode[0]);
+}
+
+#define nft_hash_for_each_entry(he, node, tbl, h)			\
+	for (node = rcu_dereference_raw(hlist_first_rcu(&(tbl)->buckets[h])); \
+	     node != NULL &&						\
+		({ he = nft_hash_entry(node, (tbl)->idx); 1; });	\
+	     node = rcu_dereference_raw(hlist_next_rcu(node)))
+
+static u32 nft_hash_data(const struct nft_set *set,
+			 const struct nft_hash_table *tbl,
+			 const struct nft_data *data)
+{
+	const struct nft_hash *priv = nft_set_priv(set);
+
+	return jhash(data->data, set->klen, priv->seed) & (tbl->size - 1);
+}
+
+static bool nft_hash_lookup(const struct nft_set *set,
+			    const struct nft_data *key,
+			    struct nft_data *data)
+{
+	const struct nft_hash *priv = nft_set_priv(set);
+	const struct nft_hash_table *tbl = rcu_dereference(priv->tbl);
+	struct nft_hash_elem *he;
+	struct hlist_node *node;
+	u32 h;
+
+	h = nft_hash_data(set, tbl, key);
+	nft_hash_for_each_entry(he, node, tbl, h) {
+		if (nft_data_cmp(&he->key, key, set->klen))
+			continue;
+		if (set->flags & NFT_SET_MAP)
+			nft_data_copy(data, he->data);
+		return true;
+	}
+	return false;
+}
+
+static struct nft_hash_table *nft_hash_tbl_alloc(unsigned int size)
+{
+	struct nft_hash_table *tbl;
+	size_t sz;
+
+	sz = sizeof(*tbl) + size * sizeof(tbl->buckets[0]);
+	if (sz <= PAGE_SIZE)
+		tbl = kzalloc(sz, GFP_KERNEL);
+	else
+		tbl = vzalloc(sz);
+	if (tbl == NULL)
+		return NULL;
+
+	tbl->size = size;
+	return tbl;
+}
+
+static void nft_hash_tbl_free(struct nft_hash_table *tbl)
+{
+	if (is_vmalloc_addr(tbl))
+		vfree(tbl);
+	else
+		kfree(tbl);
+}
+
+static int nft_hash_tbl_expand(const struct nft_set *set, struct nft_hash *priv)
+{
+	struct nft_hash_table *tbl = nft_dereference(priv->tbl), *ntbl;
+	struct nft_hash_elem *he;
+	struct hlist_node *node;
+	unsigned int i;
+	u32 h;
+
+	ntbl = nft_hash_tbl_alloc(tbl->size * 2);
+	if (ntbl == NULL)
+		return -ENOMEM;
+	ntbl->idx = !tbl->idx;
+
+	for (i = 0; i < tbl->size; i++) {
+		nft_hash_for_each_entry(he, node, tbl, i) {
+			h = nft_hash_data(set, ntbl, &he->key);
+			hlist_add_head_rcu(&he->hnode[ntbl->idx],
+					   &ntbl->buckets[h]);
+		}
+	}
+
+	rcu_assign_pointer(priv->tbl, ntbl);
+	synchronize_rcu();
+	nft_hash_tbl_free(tbl);
+	return 0;
+}
+
+static struct nft_hash_elem *nft_hash_find(const struct nft_set *set,
+					   const struct nft_data *key)
+{
+	const struct nft_hash *priv = nft_set_priv(set);
+	const struct nft_hash_table *tbl = nft_dereference(priv->tbl);
+	struct nft_hash_elem *he;
+	struct hlist_node *node;
+	u32 h;
+
+	h = nft_hash_data(set, tbl, key);
+	nft_hash_for_each_entry(he, node, tbl, h) {
+		if (!nft_data_cmp(&he->key, key, set->klen))
+			return he;
+	}
+	return NULL;
+}
+
+static int nft_hash_insert(const struct nft_set *set,
+			   const struct nft_set_elem *elem)
+{
+	struct nft_hash *priv = nft_set_priv(set);
+	struct nft_hash_table *tbl = nft_dereference(priv->tbl);
+	struct nft_hash_elem *he;
+	unsigned int size;
+	u32 h;
+
+	if (elem->flags != 0)
+		return -EINVAL;
+
+	if (nft_hash_find(set, &elem->key) != NULL)
+		return -EEXIST;
+
+	size = sizeof(*he);
+	if (set->flags & NFT_SET_MAP)
+		size += sizeof(he->data[0]);
+
+	he = kzalloc(size, GFP_KERNEL);
+	if (he == NULL)
+		return -ENOMEM;
+
+	nft_data_copy(&he->key, &elem->key);
+	if (set->flags & NFT_SET_MAP)
+		nft_data_copy(he->data, &elem->data);
+
+	h = nft_hash_data(set, tbl, &he->key);
+	hlist_add_head_rcu(&he->hnode[tbl->idx], &tbl->buckets[h]);
+	priv->nelems++;
+
+	/* Failure to grow only makes the chains longer */
+	if (priv->nelems > tbl->size / 4 * 3)
+		nft_hash_tbl_expand(set, priv);
+
+	return 0;
+}
+
+static void nft_hash_remove(const struct nft_set *set,
+			    const struct nft_set_elem *elem)
+{
+	struct nft_hash *priv = nft_set_priv(set);
+	struct nft_hash_table *tbl = nft_dereference(priv->tbl);
+	struct nft_hash_elem *he;
+
+	he = nft_hash_find(set, &elem->key);
+	if (he == NULL)
+		return;
+
+	hlist_del_rcu(&he->hnode[tbl->idx]);
+	priv->nelems--;
+	kfree_rcu(he, rcu);
+}
+
+static int nft_hash_get(const struct nft_set *set, struct nft_set_elem *elem)
+{
+	const struct nft_hash_elem *he;
+
+	he = nft_hash_find(set, &elem->key);
+	if (he == NULL)
+		return -ENOENT;
+
+	if (set->flags & NFT_SET_MAP)
+		nft_data_copy(&elem->data, he->data);
+	elem->flags = 0;
+	return 0;
+}
+
+static void nft_hash_walk(const struct nft_ctx *ctx, const struct nft_set *set,
+			  struct nft_set_iter *iter)
+{
+	const struct nft_hash *priv = nft_set_priv(set);
+	const struct nft_hash_table *tbl;
+	struct nft_hash_elem *he;
+	struct hlist_node *node;
+	struct nft_set_elem elem;
+	unsigned int i;
+
+	rcu_read_lock();
+	tbl = rcu_dereference(priv->tbl);
+	for (i = 0; i < tbl->size; i++) {
+		nft_hash_for_each_entry(he, node, tbl, i) {
+			if (iter->count < iter->skip)
+				goto cont;
+
+			memcpy(&elem.key, &he->key, sizeof(elem.key));
+			if (set->flags & NFT_SET_MAP)
+				memcpy(&elem.data, he->data, sizeof(elem.data));
+			elem.flags = 0;
+
+			iter->err = iter->fn(ctx, set, iter, &elem);
+			if (iter->err < 0)
+				goto out;
+cont:
+			iter->count++;
+		}
+	}
+out:
+	rcu_read_unlock();
+}
+
+static unsigned int nft_hash_privsize(const struct nlattr * const nla[])
+{
+	return sizeof(struct nft_hash);
+}
+
+static int nft_hash_init(const struct nft_set *set,
+			 const struct nlattr * const tb[])
+{
+	struct nft_hash *priv = nft_set_priv(set);
+	struct nft_hash_table *tbl;
+
+	tbl = nft_hash_tbl_alloc(NFT_HASH_MIN_SIZE);
+	if (tbl == NULL)
+		return -ENOMEM;
+
+	get_random_bytes(&priv->seed, sizeof(priv->seed));
+	priv->nelems = 0;
+	RCU_INIT_POINTER(priv->tbl, tbl);
+	return 0;
+}
+
+static void nft_hash_destroy(const struct nft_set *set)
+{
+	const struct nft_hash *priv = nft_set_priv(set);
+	struct nft_hash_table *tbl = nft_dereference(priv->tbl);
+	struct nft_hash_elem *he;
+	struct hlist_node *node, *next;
+	unsigned int i;
+
+	for (i = 0; i < tbl->size; i++) {
+		for (node = tbl->buckets[i].first; node != NULL; node = next) {
+			next = node->next;
+			he = nft_hash_entry(node, tbl->idx);
+			if (set->flags & NFT_SET_MAP)
+				nft_data_uninit(he->data, set->dtype);
+			kfree(he);
+		}
+	}
+	nft_hash_tbl_free(tbl);
+}
+
+static struct nft_set_ops nft_hash_ops __read_mostly = {
+	.privsize       = nft_hash_privsize,
+	.init		= nft_hash_init,
+	.destroy	= nft_hash_destroy,
+	.get		= nft_hash_get,
+	.insert		= nft_hash_insert,
+	.remove		= nft_hash_remove,
+	.lookup		= nft_hash_lookup,
+	.walk		= nft_hash_walk,
+	.features	= NFT_SET_MAP,
+	.owner		= THIS_MODULE,
+};
+
+static int __init nft_hash_module_init(void)
+{
+	return nft_register_set(&nft_hash_ops);
+}
+
+static void __exit nft_hash_module_exit(void)
+{
+	nft_unregister_set(&nft_hash_ops);
+}
+
+module_init(nft_hash_module_init);
+module_exit(nft_hash_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_NFT_SET();
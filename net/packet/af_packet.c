@@ -294,6 +294,7 @@ struct packet_sock {
 	unsigned int		tp_reserve;
 	unsigned int		tp_loss:1;
 	unsigned int		tp_tstamp;
+	int			(*xmit)(struct sk_buff *skb);
 	struct packet_type	prot_hook ____cacheline_aligned_in_smp;
 };
 
@@ -308,6 +309,7 @@ struct packet_fanout {
 	u8			type;
 	u8			defrag;
 	atomic_t		rr_cur;
+	struct sk_filter __rcu	*bpf_prog;
 	struct list_head	list;
 	struct sock		*arr[PACKET_FANOUT_MAX];
 	spinlock_t		lock;
@@ -404,6 +406,7 @@ static void __packet_set_status(struct packet_sock *po, void *frame, int status)
 	union {
 		struct tpacket_hdr *h1;
 		struct tpacket2_hdr *h2;
+		struct tpacket3_hdr *h3;
 		void *raw;
 	} h;
 
@@ -418,6 +421,9 @@ static void __packet_set_status(struct packet_sock *po, void *frame, int status)
 		flush_dcache_page(pgv_to_page(&h.h2->tp_status));
 		break;
 	case TPACKET_V3:
+		h.h3->tp_status = status;
+		flush_dcache_page(pgv_to_page(&h.h3->tp_status));
+		break;
 	default:
 		WARN(1, "TPACKET version not supported.\n");
 		BUG();
@@ -431,6 +437,7 @@ static int __packet_get_status(struct packet_sock *po, void *frame)
 	union {
 		struct tpacket_hdr *h1;
 		struct tpacket2_hdr *h2;
+		struct tpacket3_hdr *h3;
 		void *raw;
 	} h;
 
@@ -445,6 +452,8 @@ static int __packet_get_status(struct packet_sock *po, void *frame)
 		flush_dcache_page(pgv_to_page(&h.h2->tp_status));
 		return h.h2->tp_status;
 	case TPACKET_V3:
+		flush_dcache_page(pgv_to_page(&h.h3->tp_status));
+		return h.h3->tp_status;
 	default:
 		WARN(1, "TPACKET version not supported.\n");
 		BUG();
@@ -1212,6 +1221,20 @@ static struct sock *fanout_demux_cpu(struct packet_fanout *f, struct sk_buff *sk
 	return f->arr[cpu % num];
 }
 
+static struct sock *fanout_demux_bpf(struct packet_fanout *f, struct sk_buff *skb, unsigned int num)
+{
+	struct sk_filter *prog;
+	unsigned int idx = 0;
+
+	rcu_read_lock();
+	prog = rcu_dereference(f->bpf_prog);
+	if (prog)
+		idx = SK_RUN_FILTER(prog, skb) % num;
+	rcu_read_unlock();
+
+	return f->arr[idx];
+}
+
 static int packet_rcv_fanout(struct sk_buff *skb, struct net_device *dev,
 			     struct packet_type *pt, struct net_device *orig_dev)
 {
@@ -1243,6 +1266,9 @@ static int packet_rcv_fanout(struct sk_buff *skb, struct net_device *dev,
 	case PACKET_FANOUT_CPU:
 		sk = fanout_demux_cpu(f, skb, num);
 		break;
+	case PACKET_FANOUT_CBPF:
+		sk = fanout_demux_bpf(f, skb, num);
+		break;
 	}
 
 	po = pkt_sk(sk);
@@ -1292,6 +1318,7 @@ static int fanout_add(struct sock *sk, u16 id, u16 type_flags)
 	case PACKET_FANOUT_HASH:
 	case PACKET_FANOUT_LB:
 	case PACKET_FANOUT_CPU:
+	case PACKET_FANOUT_CBPF:
 		break;
 	default:
 		return -EINVAL;
@@ -1353,6 +1380,67 @@ out:
 	return err;
 }
 
+static void __fanout_set_data_bpf(struct packet_fanout *f,
+				  struct sk_filter *new)
+{
+	struct sk_filter *old;
+
+	spin_lock(&f->lock);
+	old = rcu_dereference_protected(f->bpf_prog, lockdep_is_held(&f->lock));
+	rcu_assign_pointer(f->bpf_prog, new);
+	spin_unlock(&f->lock);
+
+	if (old)
+		sk_unattached_filter_destroy(old);
+}
+
+static int fanout_set_data_bpf(struct packet_sock *po, char __user *data,
+			       unsigned int len)
+{
+	struct sock_fprog fprog, kprog;
+	struct sock_filter *insns;
+	struct sk_filter *new;
+	unsigned int fsize;
+	int ret;
+
+	if (len != sizeof(fprog))
+		return -EINVAL;
+	if (copy_from_user(&fprog, data, len))
+		return -EFAULT;
+	if (fprog.len == 0 || fprog.len > BPF_MAXINSNS)
+		return -EINVAL;
+
+	fsize = sizeof(struct sock_filter) * fprog.len;
+	insns = kmalloc(fsize, GFP_KERNEL);
+	if (!insns)
+		return -ENOMEM;
+	if (copy_from_user(insns, fprog.filter, fsize)) {
+		kfree(insns);
+		return -EFAULT;
+	}
+
+	kprog.len = fprog.len;
+	kprog.filter = (struct sock_filter __user *)insns;
+	ret = sk_unattached_filter_create(&new, &kprog);
+	kfree(insns);
+	if (ret)
+		return ret;
+
+	__fanout_set_data_bpf(po->fanout, new);
+	return 0;
+}
+
+static int fanout_set_data(struct packet_sock *po, char __user *data,
+			   unsigned int len)
+{
+	switch (po->fanout->type) {
+	case PACKET_FANOUT_CBPF:
+		return fanout_set_data_bpf(po, data, len);
+	default:
+		return -EINVAL;
+	}
+}
+
 static void fanout_release(struct sock *sk)
 {
 	struct packet_sock *po = pkt_sk(sk);
@@ -1368,6 +1456,7 @@ static void fanout_release(struct sock *sk)
 	if (atomic_dec_and_test(&f->sk_ref)) {
 		list_del(&f->list);
 		dev_remove_pack(&f->prot_hook);
+		__fanout_set_data_bpf(f, NULL);
 		kfree(f);
 	}
 	mutex_unlock(&fanout_mutex);
@@ -1936,6 +2025,68 @@ ring_is_full:
 	goto drop_n_restore;
 }
 
+static u16 packet_pick_tx_queue(struct net_device *dev)
+{
+	return (u16) raw_smp_processor_id() % dev->real_num_tx_queues;
+}
+
+/*
+ * PACKET_QDISC_BYPASS: hand the frame straight to the driver on a
+ * queue picked by the current CPU, skipping the qdisc layer and the
+ * taps of other packet sockets. Frames needing segmentation or
+ * checksumming in software still go through dev_queue_xmit().
+ */
+static int packet_direct_xmit(struct sk_buff *skb)
+{
+	struct net_device *dev = skb->dev;
+	const struct net_device_ops *ops = dev->netdev_ops;
+	netdev_features_t features;
+	struct netdev_queue *txq;
+	int ret = NETDEV_TX_BUSY;
+
+	if (unlikely(!netif_running(dev) ||
+		     !netif_carrier_ok(dev)))
+		goto drop;
+
+	if (skb_is_gso(skb) || skb->ip_summed == CHECKSUM_PARTIAL)
+		return dev_queue_xmit(skb);
+
+	features = netif_skb_features(skb);
+	if (skb_is_nonlinear(skb) &&
+	    ((skb_has_frag_list(skb) && !(features & NETIF_F_FRAGLIST)) ||
+	     (skb_shinfo(skb)->nr_frags && !(features & NETIF_F_SG))) &&
+	    __skb_linearize(skb))
+		goto drop;
+
+	skb_set_queue_mapping(skb, packet_pick_tx_queue(dev));
+	txq = netdev_get_tx_queue(dev, skb_get_queue_mapping(skb));
+
+	local_bh_disable();
+
+	HARD_TX_LOCK(dev, txq, smp_processor_id());
+	if (!netif_xmit_frozen_or_stopped(txq)) {
+		ret = ops->ndo_start_xmit(skb, dev);
+		if (ret == NETDEV_TX_OK)
+			txq_trans_update(txq);
+	}
+	HARD_TX_UNLOCK(dev, txq);
+
+	local_bh_enable();
+
+	if (!dev_xmit_complete(ret))
+		kfree_skb(skb);
+
+	return ret;
+drop:
+	kfree_skb(skb);
+	return NET_XMIT_DROP;
+}
+
+static bool packet_use_direct_xmit(const struct packet_sock *po)
+{
+	return po->xmit == packet_direct_xmit;
+}
+
 static void tpacket_destruct_skb(struct sk_buff *skb)
 {
 	struct packet_sock *po = pkt_sk(skb->sk);
@@ -1959,6 +2110,7 @@ static int tpacket_fill_skb(struct packet_sock *po, struct sk_buff *skb,
 	union {
 		struct tpacket_hdr *h1;
 		struct tpacket2_hdr *h2;
+		struct tpacket3_hdr *h3;
 		void *raw;
 	} ph;
 	int to_write, offset, len, tp_len, nr_frags, len_max;
@@ -1976,6 +2128,16 @@ static int tpacket_fill_skb(struct packet_sock *po, struct sk_buff *skb,
 	skb_shinfo(skb)->destructor_arg = ph.raw;
 
 	switch (po->tp_version) {
+	case TPACKET_V3:
+		/* Frames are fixed size slots on the Tx ring, packing
+		 * them with tp_next_offset is not supported (yet).
+		 */
+		if (unlikely(ph.h3->tp_next_offset != 0)) {
+			pr_err("variable sized slot not supported\n");
+			return -EINVAL;
+		}
+		tp_len = ph.h3->tp_len;
+		break;
 	case TPACKET_V2:
 		tp_len = ph.h2->tp_len;
 		break;
@@ -2143,7 +2305,7 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 		atomic_inc(&po->tx_ring.pending);
 
 		status = TP_STATUS_SEND_REQUEST;
-		err = dev_queue_xmit(skb);
+		err = po->xmit(skb);
 		if (unlikely(err > 0)) {
 			err = net_xmit_errno(err);
 			if (err && __packet_get_status(po, ph) ==
@@ -2380,7 +2542,7 @@ static int packet_snd(struct socket *sock,
 	 *	Now send it
 	 */
 
-	err = dev_queue_xmit(skb);
+	err = po->xmit(skb);
 	if (err > 0 && (err = net_xmit_errno(err)) != 0)
 		goto out_unlock;
 
@@ -2607,6 +2769,7 @@ static int packet_create(struct net *net, struct socket *sock, int protocol,
 	po = pkt_sk(sk);
 	sk->sk_family = PF_PACKET;
 	po->num = proto;
+	po->xmit = dev_queue_xmit;
 
 	sk->sk_destruct = packet_sock_destruct;
 	sk_refcnt_debug_inc(sk);
@@ -2755,7 +2918,8 @@ static int packet_recvmsg(struct kiocb *iocb, struct socket *sock,
 				vnet_hdr.gso_type = VIRTIO_NET_HDR_GSO_TCPV6;
 			else if (sinfo->gso_type & SKB_GSO_UDP)
 				vnet_hdr.gso_type = VIRTIO_NET_HDR_GSO_UDP;
-			else if (sinfo->gso_type & SKB_GSO_FCOE)
+			else if (sinfo->gso_type & (SKB_GSO_FCOE |
+						     SKB_GSO_UDP_L4))
 				goto out_free;
 			else
 				BUG();
@@ -3215,6 +3379,25 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 
 		return fanout_add(sk, val & 0xffff, val >> 16);
 	}
+	case PACKET_QDISC_BYPASS:
+	{
+		int val;
+
+		if (optlen != sizeof(val))
+			return -EINVAL;
+		if (copy_from_user(&val, optval, sizeof(val)))
+			return -EFAULT;
+
+		po->xmit = val ? packet_direct_xmit : dev_queue_xmit;
+		return 0;
+	}
+	case PACKET_FANOUT_DATA:
+	{
+		if (!po->fanout)
+			return -EINVAL;
+
+		return fanout_set_data(po, optval, optlen);
+	}
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -3338,6 +3521,12 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 		       0);
 		data = &val;
 		break;
+	case PACKET_QDISC_BYPASS:
+		if (len > sizeof(int))
+			len = sizeof(int);
+		val = packet_use_direct_xmit(po);
+		data = &val;
+		break;
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -3595,12 +3784,6 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 	/* Added to avoid minimal code churn */
 	struct tpacket_req *req = &req_u->req;
 
-	/* Opening a Tx-ring is NOT supported in TPACKET_V3 */
-	if (!closing && tx_ring && (po->tp_version > TPACKET_V2)) {
-		WARN(1, "Tx-ring is not supported.\n");
-		goto out;
-	}
-
 	rb = tx_ring ? &po->tx_ring : &po->rx_ring;
 	rb_queue = tx_ring ? &sk->sk_write_queue : &sk->sk_receive_queue;
 
@@ -3655,12 +3838,22 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 			goto out;
 		switch (po->tp_version) {
 		case TPACKET_V3:
-		/* Transmit path is not supported. We checked
-		 * it above but just being paranoid
-		 */
-			if (!tx_ring)
+			/* The Tx ring uses the V3 frame header in fixed
+			 * size slots; block retirement only applies to Rx.
+			 */
+			if (!tx_ring) {
 				init_prb_bdqc(po, rb, pg_vec, req_u, tx_ring);
-				break;
+			} else {
+				struct tpacket_req3 *req3 = &req_u->req3;
+
+				if (req3->tp_retire_blk_tov ||
+				    req3->tp_sizeof_priv ||
+				    req3->tp_feature_req_word) {
+					err = -EINVAL;
+					goto out_free_pg_vec;
+				}
+			}
+			break;
 		default:
 			break;
 		}
@@ -3717,12 +3910,13 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 	}
 	spin_unlock(&po->bind_lock);
 	if (closing && (po->tp_version > TPACKET_V2)) {
-		/* Because we don't support block-based V3 on tx-ring */
+		/* The block retire timer only runs for the Rx ring */
 		if (!tx_ring)
 			prb_shutdown_retire_blk_timer(po, tx_ring, rb_queue);
 	}
 	release_sock(sk);
 
+out_free_pg_vec:
 	if (pg_vec)
 		free_pg_vec(pg_vec, order, req->tp_block_nr);
 out:
@@ -18,6 +18,7 @@
 #include <linux/netdevice.h>
 #include <linux/init.h>
 #include <linux/skbuff.h>
+#include <linux/ip.h>
 #include <linux/moduleparam.h>
 #include <net/dst.h>
 #include <net/neighbour.h>
@@ -278,9 +279,22 @@ static inline int teql_resolve(struct sk_buff *skb,
 
 	rcu_read_lock();
 	mn = dst_get_neighbour_noref(dst);
-	res = mn ? __teql_resolve(skb, skb_res, dev, txq, mn) : 0;
+	if (mn) {
+		res = __teql_resolve(skb, skb_res, dev, txq, mn);
+		rcu_read_unlock();
+		return res;
+	}
 	rcu_read_unlock();
 
+	/* IPv4 routes to a directly connected subnet carry no neighbour */
+	if (skb->protocol != htons(ETH_P_IP))
+		return 0;
+	mn = dst_neigh_lookup(dst, &ip_hdr(skb)->daddr);
+	if (IS_ERR(mn))
+		return PTR_ERR(mn);
+	res = __teql_resolve(skb, skb_res, dev, txq, mn);
+	neigh_release(mn);
+
 	return res;
 }
 
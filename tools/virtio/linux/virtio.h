@@ -164,6 +164,7 @@ struct virtqueue {
 	const char *name;
 	struct virtio_device *vdev;
 	void *priv;
+	unsigned int index;
 };
 
 #define EXPORT_SYMBOL_GPL(__EXPORT_SYMBOL_GPL_name) \
@@ -205,7 +206,8 @@ void virtqueue_disable_cb(struct virtqueue *vq);
 bool virtqueue_enable_cb(struct virtqueue *vq);
 
 void *virtqueue_detach_unused_buf(struct virtqueue *vq);
-struct virtqueue *vring_new_virtqueue(unsigned int num,
+struct virtqueue *vring_new_virtqueue(unsigned int index,
+				      unsigned int num,
 				      unsigned int vring_align,
 				      struct virtio_device *vdev,
 				      bool weak_barriers,